@@ -43,6 +43,9 @@ namespace idt {
     } __packed;
 
     void isr_handler(uint8_t no, uint32_t err, void* ctx_ptr);
+
+    // The frame a context_switch stub pops: `saved`, or the one a handler asked to switch to.
+    InterruptFrame* resume_frame(InterruptFrame* saved);
 }
 
 /*
@@ -101,6 +104,11 @@ __naked void context_switch() {
 
          "add $12, %%esp\n"                      // pop args, 4 * 3 = 12
 
+         "push %%esp\n"                          // saved = &InterruptFrame
+         "mov %[resume], %%eax\n"                // eax = &idt::resume_frame
+         "call *%%eax\n"                         // call idt::resume_frame(&InterruptFrame)
+         "mov %%eax, %%esp\n"                    // switch to the frame to resume, dropping the arg
+
          "xor %%eax, %%eax\n"
 
          "pop %%eax\n"
@@ -123,7 +131,8 @@ __naked void context_switch() {
          :
          : [int_no] "i" (N),
            [base_offset] "i" (__builtin_offsetof(idt::InterruptFrame, base)),
-           [handler] "i" (&idt::isr_handler)
+           [handler] "i" (&idt::isr_handler),
+           [resume] "i" (&idt::resume_frame)
          : "memory", "eax"
     );
 }
@@ -143,7 +152,7 @@ namespace idt {
 
     template <int N>
     constexpr ISRDescritpor get_isr_wrapper() {
-        if constexpr (N == 32 || N == 48)
+        if constexpr (N == 32 || N == 48 || N == 50)
             return {
                 .entry          = (uint32_t)&context_switch<N>,
                 .kind           = InterruptFrameKind::ContextSwitch,
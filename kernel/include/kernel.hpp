@@ -15,7 +15,6 @@ class Kernel {
         kstd::StaticSlot<Linker> _linker;
         kstd::StaticSlot<ModuleManager> _mmanager;
         kstd::StaticSlot<apic> _apic;
-        kstd::StaticSlot<sched::Scheduler> _sched;
         kstd::StaticSlot<smp::CoreManager> _cmanager;
 
         multiboot_info_t _mboot;
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <klibcpp/cstdlib.hpp>
+#include <klibcpp/utility.hpp>
+#include <klibcpp/trivial.hpp>
+#include <mm/slab.hpp>
+
+namespace kstd {
+
+    /*
+        Typed front-end for mm::SlabCache. create() constructs T in a slab
+        object and destroy() runs ~T before handing the memory back, so hot
+        fixed-size objects skip the heap lock and chunk headers. Like `new T`,
+        create() without arguments default-initializes.
+    */
+    template <typename T>
+    class ObjectCache : public NonTransferable {
+        public:
+            constexpr explicit ObjectCache(const char* name)
+                : cache_(name, sizeof(T), alignof(T)) {}
+
+            template <typename... Args>
+            T* create(Args&&... args) {
+                void* mem = cache_.alloc();
+                if (!mem)
+                    return nullptr;
+
+                if constexpr (sizeof...(Args) == 0)
+                    return new (mem) T;
+                else
+                    return new (mem) T(static_cast<Args&&>(args)...);
+            }
+
+            void destroy(T* object) {
+                if (!object)
+                    return;
+
+                object->~T();
+                cache_.free(object);
+            }
+
+            mm::SlabCache& cache() {
+                return cache_;
+            }
+
+        private:
+            mm::SlabCache cache_;
+    };
+}
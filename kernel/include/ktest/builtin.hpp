@@ -5,12 +5,18 @@
 #include <driver/pit.hpp>
 #include <klibcpp/atomic.hpp>
 #include <klibcpp/bitmap.hpp>
+#include <klibcpp/buddy.hpp>
 #include <klibcpp/kstd.hpp>
 #include <klibcpp/memory.hpp>
+#include <klibcpp/object_cache.hpp>
 #include <klibcpp/spinlock.hpp>
 #include <klibcpp/static_array.hpp>
 #include <klibcpp/static_slot.hpp>
+#include <mm/vspace.hpp>
+#include <sched/sync.hpp>
+#include <sched/wait_queue.hpp>
 #include <multiboot_utils.hpp>
+#include <sys/kexp.hpp>
 #include <ktest/compile_time.hpp>
 #include <ktest/engine.hpp>
 
@@ -33,12 +39,30 @@ namespace ktest {
             uint32_t slot_dtor_count   = 0;
             uint32_t array_ctor_count  = 0;
             uint32_t array_dtor_count  = 0;
+            uint32_t slab_ctor_count   = 0;
+            uint32_t slab_dtor_count   = 0;
             uint32_t atexit_calls      = 0;
             uint32_t task1_runs        = 0;
             uint32_t task2_runs        = 0;
 
             bool     task1_finished    = false;
             bool     task2_finished    = false;
+
+            kstd::Atomic<uint32_t> placed_runs;
+            kstd::Atomic<uint32_t> placed_cores; // Bit per logical core id.
+            kstd::Atomic<uint32_t> queued_runs;
+            kstd::Atomic<uint32_t> queued_same_task;
+            kstd::Atomic<sched::Task*> queued_tasks[4];
+            kstd::Atomic<uint32_t> urgent_runs;
+            kstd::Atomic<uint32_t> own_stack_runs;
+            kstd::Atomic<uint32_t> sleep_ticks;
+            kstd::Atomic<uint32_t> event_ready;
+            kstd::Atomic<uint32_t> event_waiters_done;
+            uint32_t               mutex_counter;
+            kstd::Atomic<uint32_t> mutex_tasks_done;
+            kstd::Atomic<uint32_t> sem_acquired;
+            bool                   cond_ready;
+            kstd::Atomic<uint32_t> cond_woken;
         };
 
         inline State& state() {
@@ -138,6 +162,122 @@ namespace ktest {
             state().task2_finished = true;
         }
 
+        inline void placed_task_entry() {
+            // Stay live long enough that placement sees every earlier spawn.
+            pit::sleep_us(20 * 1000);
+            state().placed_cores.fetch_or(1u << smp::CoreManager::current_core()->id);
+            state().placed_runs.fetch_add(1);
+        }
+
+        inline sched::Task* running_task() {
+            kstd::InterruptGuard guard;
+            return &smp::CoreManager::current_core()->scheduler().current_task();
+        }
+
+        inline void queued_task_entry() {
+            sched::Task* self = running_task();
+
+            pit::sleep_us(20 * 1000);
+            state().queued_runs.fetch_add(1);
+
+            // A stolen task is still the object create_task() returned, not a copy.
+            if (running_task() != self)
+                return;
+
+            for (auto& queued : state().queued_tasks) {
+                if (queued.load() == self)
+                    state().queued_same_task.fetch_add(1);
+            }
+        }
+
+        inline void urgent_task_entry() {
+            state().urgent_runs.fetch_add(1);
+        }
+
+        inline void own_stack_task_entry() {
+            volatile uint32_t marks[16];
+            uint32_t          sp;
+
+            __asm__ volatile ("mov %%esp, %0" : "=r" (sp));
+
+            const bool on_own_stack = running_task()->stack == smp::BaseCoreStack::from_sp(sp);
+
+            for (uint32_t i = 0; i < 16; i++)
+                marks[i] = sp ^ i;
+
+            // Busy-wait across several preemptions while sibling tasks run.
+            pit::sleep_us(30 * 1000);
+
+            bool intact = true;
+            for (uint32_t i = 0; i < 16; i++)
+                intact = intact && marks[i] == (sp ^ i);
+
+            if (on_own_stack && intact)
+                state().own_stack_runs.fetch_add(1);
+        }
+
+        inline void sleeper_task_entry() {
+            const uint64_t start = pit::ticks();
+            sched::sleep_for(30 * 1000);
+            state().sleep_ticks.store(static_cast<uint32_t>(pit::ticks() - start));
+        }
+
+        inline sched::WaitQueue& event_queue() {
+            static sched::WaitQueue value;
+            return value;
+        }
+
+        inline sched::Mutex& sync_mutex() {
+            static sched::Mutex value;
+            return value;
+        }
+
+        inline sched::Semaphore& sync_semaphore() {
+            static sched::Semaphore value;
+            return value;
+        }
+
+        inline sched::CondVar& sync_condvar() {
+            static sched::CondVar value;
+            return value;
+        }
+
+        static constexpr uint32_t MUTEX_TASKS      = 4;
+        static constexpr uint32_t MUTEX_ITERATIONS = 8;
+
+        inline void mutex_task_entry() {
+            for (uint32_t i = 0; i < MUTEX_ITERATIONS; i++) {
+                sched::MutexGuard guard(sync_mutex());
+
+                // Sleeping inside the section makes every other task queue up behind it.
+                const uint32_t value = state().mutex_counter;
+                sched::sleep_for(1000);
+                state().mutex_counter = value + 1;
+            }
+
+            state().mutex_tasks_done.fetch_add(1);
+        }
+
+        inline void semaphore_task_entry() {
+            sync_semaphore().acquire();
+            state().sem_acquired.fetch_add(1);
+        }
+
+        inline void condvar_task_entry() {
+            sched::MutexGuard guard(sync_mutex());
+            sync_condvar().wait(sync_mutex(), []() {
+                    return state().cond_ready;
+                });
+            state().cond_woken.fetch_add(1);
+        }
+
+        inline void event_waiter_entry() {
+            event_queue().wait_until([]() {
+                    return state().event_ready.load() != 0;
+                });
+            state().event_waiters_done.fetch_add(1);
+        }
+
         inline uint32_t low_boot_reserved_end(const Kernel& kernel) {
             uint32_t       reserved_end = mm::align_up(reinterpret_cast<uint32_t>(&__kernel_end), mm::PAGE_SIZE);
             const uint32_t modules_end  = multiboot::max_module_end_aligned(kernel._mboot);
@@ -166,6 +306,19 @@ namespace ktest {
             return 0;
         }
 
+        // A private heap on an unmapped PDE, so a case can lay chunks out exactly.
+        template<typename Fn>
+        inline void with_scratch_heap(Fn&& fn) {
+            constexpr uint32_t span = mm::layout::virt::IDENTITY_WINDOW_SIZE;
+            const uint32_t     base = find_fresh_test_page_base();
+
+            Heap*              heap = new Heap(base, HEAP_MIN_SIZE, base + span, mm::Present | mm::Writable);
+            fn(*heap, base);
+            delete heap;
+
+            mm::vmm::unmap_pages(base, span / mm::PAGE_SIZE);
+        }
+
         inline void run_runtime_suite(ktest::Session& sess) {
             sess.begin_suite("runtime");
 
@@ -456,6 +609,154 @@ namespace ktest {
                     KTEST_EXPECT(sess, !alloc.allocated(run + 0x1000));
                 });
 
+            run_case(sess, "bitmap-allocator-word-scan", [&]() {
+                    using TestBitmap = FixedBitmapAllocator<0, 1280, 0x1000>;
+
+                    TestBitmap alloc;
+
+                    alloc.set();
+                    KTEST_EXPECT(sess, alloc.mark_units_free(1000 * 0x1000, 100) == 100);
+                    KTEST_EXPECT(sess, alloc.mark_units_free(1050 * 0x1000, 100) == 50);
+                    KTEST_EXPECT(sess, alloc.free_unit_count() == 150);
+
+                    KTEST_EXPECT(sess, alloc.mark_units_used(1030 * 0x1000, 4) == 4);
+                    KTEST_EXPECT(sess, alloc.alloc_units(40) == 1034 * 0x1000);
+                    KTEST_EXPECT(sess, alloc.alloc_units(30) == 1000 * 0x1000);
+                    KTEST_EXPECT(sess, alloc.alloc_unit() == 1074 * 0x1000);
+
+                    KTEST_EXPECT(sess, alloc.mark_units_used(1070 * 0x1000, 10) == 5);
+                    KTEST_EXPECT(sess, alloc.free_unit_count() == 70);
+
+                    alloc.free_units(1034 * 0x1000, 40);
+                    KTEST_EXPECT(sess, alloc.alloc_units(70) == 1080 * 0x1000);
+                    KTEST_EXPECT(sess, alloc.alloc_units(40) == 1034 * 0x1000);
+                    KTEST_EXPECT(sess, alloc.free_unit_count() == 0);
+                });
+
+            run_case(sess, "bitmap-allocator-try-alloc", [&]() {
+                    using TestBitmap = FixedBitmapAllocator<0x800000, 8, 0x1000>;
+
+                    TestBitmap alloc;
+                    uint32_t   addr = 0;
+
+                    alloc.set();
+                    alloc.mark_units_free(0x801000, 2);
+                    alloc.mark_units_free(0x804000, 1);
+
+                    // Three units are free, but no run of three.
+                    KTEST_EXPECT(sess, !alloc.try_alloc_units(3, addr));
+                    KTEST_EXPECT(sess, !alloc.try_alloc_units(9, addr));
+                    KTEST_EXPECT(sess, alloc.free_unit_count() == 3);
+
+                    KTEST_EXPECT(sess, alloc.try_alloc_units(2, addr));
+                    KTEST_EXPECT(sess, addr == 0x801000);
+                    KTEST_EXPECT(sess, alloc.free_unit_count() == 1);
+                });
+
+            run_case(sess, "buddy-allocator", [&]() {
+                    using TestBuddy = FixedBuddyAllocator<0x400000, 64, 0x1000, 3>;
+
+                    TestBuddy alloc;
+
+                    KTEST_EXPECT(sess, alloc.free_unit_count() == 0);
+                    KTEST_EXPECT(sess, alloc.allocated(0x400000));
+
+                    alloc.clear();
+                    KTEST_EXPECT(sess, alloc.free_unit_count() == 64);
+                    KTEST_EXPECT(sess, !alloc.allocated(0x400000));
+
+                    uint32_t a = alloc.alloc_unit();
+                    uint32_t b = alloc.alloc_units(2);
+                    uint32_t c = alloc.alloc_units(3);
+
+                    KTEST_EXPECT(sess, a == 0x400000);
+                    KTEST_EXPECT(sess, b == 0x402000);
+                    KTEST_EXPECT(sess, c == 0x404000);
+                    KTEST_EXPECT(sess, alloc.allocated(c + 0x2000));
+                    KTEST_EXPECT(sess, !alloc.allocated(c + 0x3000));
+                    KTEST_EXPECT(sess, alloc.allocated_unit_count() == 6);
+
+                    alloc.free_unit(a);
+                    alloc.free_units(b, 2);
+                    alloc.free_units(c, 3);
+                    KTEST_EXPECT(sess, alloc.free_unit_count() == 64);
+
+                    // Blocks must coalesce back: a run larger than MaxOrder spans two top blocks.
+                    uint32_t run = alloc.alloc_units(12);
+                    KTEST_EXPECT(sess, run == 0x400000);
+                    KTEST_EXPECT(sess, alloc.allocated(run + 11 * 0x1000));
+                    KTEST_EXPECT(sess, !alloc.allocated(run + 12 * 0x1000));
+                    alloc.free_units(run, 12);
+                    KTEST_EXPECT(sess, alloc.free_unit_count() == 64);
+                });
+
+            run_case(sess, "buddy-allocator-mark-ranges", [&]() {
+                    using TestBuddy = FixedBuddyAllocator<0x800000, 32, 0x1000, 2>;
+
+                    TestBuddy alloc;
+
+                    alloc.set();
+                    alloc.mark_units_free(0x801000, 6);
+                    KTEST_EXPECT(sess, alloc.free_unit_count() == 6);
+                    KTEST_EXPECT(sess, alloc.allocated(0x800000));
+                    KTEST_EXPECT(sess, !alloc.allocated(0x801000));
+                    KTEST_EXPECT(sess, !alloc.allocated(0x806000));
+                    KTEST_EXPECT(sess, alloc.allocated(0x807000));
+
+                    alloc.mark_units_free(0x800000, 8);
+                    KTEST_EXPECT(sess, alloc.free_unit_count() == 8);
+
+                    alloc.mark_units_used(0x803000, 2);
+                    KTEST_EXPECT(sess, alloc.free_unit_count() == 6);
+                    KTEST_EXPECT(sess, alloc.allocated(0x803000));
+                    KTEST_EXPECT(sess, alloc.allocated(0x804000));
+                    KTEST_EXPECT(sess, !alloc.allocated(0x802000));
+                    KTEST_EXPECT(sess, !alloc.allocated(0x805000));
+
+                    uint32_t pair = alloc.alloc_units(2);
+                    KTEST_EXPECT(sess, pair == 0x800000 || pair == 0x806000);
+                    alloc.free_units(pair, 2);
+
+                    alloc.mark_units_free(0x803000, 2);
+                    KTEST_EXPECT(sess, alloc.free_unit_count() == 8);
+                    KTEST_EXPECT(sess, alloc.alloc_units(4) == 0x800000);
+                });
+
+            run_case(sess, "allocator-alloc-upto", [&]() {
+                    uint32_t count = 0;
+
+                    FixedBitmapAllocator<0x400000, 16, 0x1000> bitmap;
+                    bitmap.set();
+                    bitmap.mark_units_free(0x402000, 3);
+                    bitmap.mark_units_free(0x408000, 8);
+
+                    KTEST_EXPECT(sess, bitmap.alloc_units_upto(8, count) == 0x402000);
+                    KTEST_EXPECT(sess, count == 3);
+                    KTEST_EXPECT(sess, bitmap.alloc_units_upto(4, count) == 0x408000);
+                    KTEST_EXPECT(sess, count == 4);
+                    KTEST_EXPECT(sess, bitmap.alloc_units_upto(8, count) == 0x40C000);
+                    KTEST_EXPECT(sess, count == 4);
+                    bitmap.alloc_units_upto(1, count);
+                    KTEST_EXPECT(sess, count == 0);
+                    KTEST_EXPECT(sess, bitmap.free_unit_count() == 0);
+
+                    FixedBuddyAllocator<0x800000, 32, 0x1000, 2> buddy;
+                    buddy.clear();
+
+                    KTEST_EXPECT(sess, buddy.alloc_units_upto(3, count) == 0x800000);
+                    KTEST_EXPECT(sess, count == 2);
+                    KTEST_EXPECT(sess, buddy.alloc_units_upto(16, count) == 0x804000);
+                    KTEST_EXPECT(sess, count == 4);
+                    KTEST_EXPECT(sess, buddy.free_unit_count() == 26);
+
+                    buddy.set();
+                    buddy.mark_units_free(0x810000, 1);
+                    KTEST_EXPECT(sess, buddy.alloc_units_upto(4, count) == 0x810000);
+                    KTEST_EXPECT(sess, count == 1);
+                    buddy.alloc_units_upto(4, count);
+                    KTEST_EXPECT(sess, count == 0);
+                });
+
             sess.end_suite();
         }
 
@@ -601,6 +902,122 @@ namespace ktest {
                     KTEST_EXPECT(sess, mm::pmm::total_memory() == total_before);
                 });
 
+            run_case(sess, "pmm-frame-cache-reuse", [&]() {
+                    const uint32_t free_before = mm::pmm::free_memory();
+                    const uint32_t used_before = mm::pmm::used_memory();
+
+                    const uint32_t frame0      = mm::pmm::alloc_frame();
+                    KTEST_ASSERT(sess, frame0 != 0);
+                    mm::pmm::free_frame(frame0);
+
+                    const uint32_t frame1 = mm::pmm::alloc_frame();
+                    KTEST_EXPECT(sess, frame1 == frame0);
+                    KTEST_EXPECT(sess, mm::pmm::used_memory() == used_before + mm::PAGE_SIZE);
+                    mm::pmm::free_frame(frame1);
+
+                    constexpr uint32_t count = mm::FrameCache::MAGAZINE_SIZE * 3;
+                    uint32_t frames[count];
+                    for (auto& frame : frames) {
+                        frame = mm::pmm::alloc_frame();
+                        KTEST_EXPECT(sess, frame != 0);
+                        KTEST_EXPECT(sess, (frame % mm::PAGE_SIZE) == 0);
+                    }
+
+                    KTEST_EXPECT(sess, mm::pmm::used_memory() == used_before + count * mm::PAGE_SIZE);
+
+                    for (auto frame : frames)
+                        mm::pmm::free_frame(frame);
+
+                    KTEST_EXPECT(sess, mm::pmm::used_memory() == used_before);
+                    KTEST_EXPECT(sess, mm::pmm::free_memory() == free_before);
+                });
+
+            run_case(sess, "pmm-zeroed-frame", [&]() {
+                    // Empty the pool so prezero_frames() has to clear frames here,
+                    // and dirty them so a skipped clear would show.
+                    uint32_t drained[mm::ZERO_POOL_SIZE];
+                    for (auto& frame : drained) {
+                        frame = mm::pmm::alloc_zeroed_frame();
+                        KTEST_ASSERT(sess, frame != 0);
+
+                        kstd::InterruptGuard guard;
+                        const uint32_t       virt = mm::vmm::kmap_local(frame);
+                        memset(reinterpret_cast<uint8_t*>(virt), 0xA5, mm::PAGE_SIZE);
+                        mm::vmm::kunmap_local(virt);
+                    }
+
+                    for (auto frame : drained)
+                        mm::pmm::free_frame(frame);
+
+                    KTEST_EXPECT(sess, mm::pmm::prezero_frames(2) == 2);
+
+                    const uint32_t frames[] = {
+                        mm::pmm::alloc_zeroed_frame(),
+                        mm::pmm::alloc_zeroed_frame(),
+                    };
+
+                    for (auto frame : frames) {
+                        KTEST_ASSERT(sess, frame != 0);
+
+                        bool clear = true;
+                        {
+                            kstd::InterruptGuard guard;
+                            const uint32_t       virt = mm::vmm::kmap_local(frame);
+                            const uint8_t*       page = reinterpret_cast<const uint8_t*>(virt);
+
+                            for (uint32_t i = 0; i < mm::PAGE_SIZE && clear; ++i)
+                                clear = page[i] == 0;
+
+                            mm::vmm::kunmap_local(virt);
+                        }
+
+                        KTEST_EXPECT(sess, clear);
+                    }
+
+                    for (auto frame : frames)
+                        mm::pmm::free_frame(frame);
+                });
+
+            run_case(sess, "vmm-kmap-local", [&]() {
+                    uint32_t       frames[2];
+                    const uint32_t base = mm::pmm::alloc_frames(2);
+                    KTEST_ASSERT(sess, base != 0);
+                    frames[0] = base;
+                    frames[1] = base + mm::PAGE_SIZE;
+
+                    uint32_t outer, inner, span, again;
+                    uint32_t first_word, second_word;
+                    {
+                        kstd::InterruptGuard guard;
+
+                        outer = mm::vmm::kmap_local(frames[0] + 0x20);
+                        inner = mm::vmm::kmap_local(frames[1]);
+                        *reinterpret_cast<volatile uint32_t*>(outer) = 0x4B4D4150;
+                        *reinterpret_cast<volatile uint32_t*>(inner) = 0x4C4F4341;
+                        mm::vmm::kunmap_local(inner);
+                        mm::vmm::kunmap_local(outer);
+
+                        // Both frames through one window straddling the boundary.
+                        span        = mm::vmm::kmap_local_span(frames[0] + mm::PAGE_SIZE - 8, 16);
+                        first_word  = *reinterpret_cast<volatile uint32_t*>(span + 8 - mm::PAGE_SIZE + 0x20);
+                        second_word = *reinterpret_cast<volatile uint32_t*>(span + 8);
+                        mm::vmm::kunmap_local_span(span, 16);
+
+                        again = mm::vmm::kmap_local(frames[0]);
+                        mm::vmm::kunmap_local(again);
+                    }
+
+                    KTEST_EXPECT(sess, (outer & (mm::PAGE_SIZE - 1)) == 0x20);
+                    KTEST_EXPECT(sess, inner == (outer & ~(mm::PAGE_SIZE - 1)) + mm::PAGE_SIZE);
+                    KTEST_EXPECT(sess, mm::layout::virt::region<mm::layout::virt::RegionId::ScratchSlots>().contains(inner));
+                    KTEST_EXPECT(sess, first_word == 0x4B4D4150);
+                    KTEST_EXPECT(sess, second_word == 0x4C4F4341);
+                    KTEST_EXPECT(sess, again == (outer & ~(mm::PAGE_SIZE - 1)));
+                    KTEST_EXPECT(sess, !mm::vmm::is_mapped(again));
+
+                    mm::pmm::free_frames(base, 2);
+                });
+
             run_case(sess, "pmm-low-bootstrap-pages-reserved", [&]() {
                     const uint32_t reserved_end = low_boot_reserved_end(kernel);
                     uint32_t checked            = 0;
@@ -655,6 +1072,8 @@ namespace ktest {
                     KTEST_EXPECT(sess, mm::pde_entry(virt).has_flag(mm::Present));
                     KTEST_EXPECT(sess, mm::vmm::is_mapped(virt));
                     KTEST_EXPECT(sess, mm::vmm::virt_to_phys(virt) == phys);
+                    KTEST_EXPECT(sess, mm::pte_entry(virt).has_flag(mm::Global) == mm::vmm::global_pages);
+                    KTEST_EXPECT(sess, !mm::pde_entry(virt).has_flag(mm::Global));
                     KTEST_EXPECT(sess, !mm::vmm::is_mapped(virt + mm::PAGE_SIZE));
                     KTEST_EXPECT(sess, mm::vmm::virt_to_phys(virt + mm::PAGE_SIZE) == 0xFFFFFFFFu);
 
@@ -668,6 +1087,286 @@ namespace ktest {
                     KTEST_EXPECT(sess, mm::vmm::virt_to_phys(virt) == 0xFFFFFFFFu);
                 });
 
+            run_case(sess, "vmm-tlb-batch", [&]() {
+                    constexpr uint32_t pages = 3;
+
+                    const uint32_t     virt  = find_fresh_test_page_base();
+                    uint32_t           frames[pages];
+                    for (auto& frame : frames) {
+                        frame = mm::pmm::alloc_frame();
+                        KTEST_ASSERT(sess, frame != 0);
+                    }
+
+                    mm::TlbBatch batch;
+                    mm::vmm::map_frames(virt, frames, pages, mm::Present | mm::Writable, batch);
+
+                    // Filling never-present entries has nothing to shoot down.
+                    KTEST_EXPECT(sess, batch.empty());
+                    for (uint32_t i = 0; i < pages; ++i)
+                        KTEST_EXPECT(sess, mm::vmm::virt_to_phys(virt + i * mm::PAGE_SIZE) == frames[i]);
+
+                    // Remapping the same frame with the same flags changes nothing either.
+                    mm::vmm::map_page(virt, frames[0], mm::Present | mm::Writable, batch);
+                    KTEST_EXPECT(sess, batch.empty());
+
+                    // Swapping two live translations does.
+                    mm::vmm::map_page(virt, frames[1], mm::Present | mm::Writable, batch);
+                    mm::vmm::map_page(virt + mm::PAGE_SIZE, frames[0], mm::Present | mm::Writable, batch);
+                    KTEST_EXPECT(sess, batch.count == 2);
+                    KTEST_EXPECT(sess, !batch.full_flush());
+                    KTEST_EXPECT(sess, batch.pages[0] == virt);
+                    KTEST_EXPECT(sess, batch.pages[1] == virt + mm::PAGE_SIZE);
+                    KTEST_EXPECT(sess, batch.global == mm::vmm::global_pages);
+
+                    mm::vmm::commit(batch);
+                    KTEST_EXPECT(sess, batch.empty());
+
+                    volatile uint32_t* word = reinterpret_cast<volatile uint32_t*>(virt + mm::PAGE_SIZE + 0x10);
+                    *word = 0x5A5AA5A5;
+                    KTEST_EXPECT(sess, *word == 0x5A5AA5A5);
+
+                    // Unmapped frames stay with the batch until the shootdown is sent.
+                    mm::vmm::unmap_pages(virt, pages, batch);
+                    KTEST_EXPECT(sess, !mm::vmm::is_mapped(virt));
+                    KTEST_EXPECT(sess, batch.count == pages);
+                    KTEST_EXPECT(sess, batch.frame_count >= 1 && batch.frame_count <= pages);
+                    KTEST_EXPECT(sess, batch.frames[0].base == frames[1]);
+
+                    uint32_t deferred = 0;
+                    for (uint32_t i = 0; i < batch.frame_count; ++i)
+                        deferred += batch.frames[i].count;
+
+                    KTEST_EXPECT(sess, deferred == pages);
+
+                    mm::vmm::commit(batch);
+                    KTEST_EXPECT(sess, batch.empty());
+
+                    for (uint32_t i = 0; i <= mm::TlbBatch::FLUSH_PAGES; ++i)
+                        batch.queue(virt + i * mm::PAGE_SIZE);
+
+                    KTEST_EXPECT(sess, batch.full_flush());
+                    batch.reset();
+                });
+
+            run_case(sess, "vmm-large-page", [&]() {
+                    KTEST_EXPECT(sess, mm::pde_entry(0).has_flag(mm::HugePage) == mm::vmm::large_pages);
+                    KTEST_EXPECT(sess, mm::vmm::virt_to_phys(0x1234) == 0x1234);
+
+                    if (!mm::vmm::large_pages)
+                        return;
+
+                    // Carve one 4 MiB aligned run out of a twice-as-large allocation.
+                    const uint32_t run   = mm::pmm::alloc_frames(2 * mm::LARGE_PAGE_FRAMES);
+                    KTEST_ASSERT(sess, run != 0);
+
+                    const uint32_t phys  = mm::align_up(run, mm::LARGE_PAGE_SIZE);
+                    const uint32_t head  = (phys - run) / mm::PAGE_SIZE;
+                    mm::pmm::free_frames(run, head);
+                    mm::pmm::free_frames(phys + mm::LARGE_PAGE_SIZE, mm::LARGE_PAGE_FRAMES - head);
+
+                    const uint32_t virt  = find_fresh_test_page_base();
+                    mm::vmm::map_pages(virt, phys, mm::LARGE_PAGE_FRAMES, mm::Present | mm::Writable);
+
+                    KTEST_EXPECT(sess, mm::pde_entry(virt).has_flag(mm::Present | mm::HugePage));
+                    KTEST_EXPECT(sess, mm::vmm::virt_to_phys(virt + 0x2345) == phys + 0x2345);
+
+                    volatile uint32_t* word = reinterpret_cast<volatile uint32_t*>(virt + 2 * mm::PAGE_SIZE);
+                    *word = 0xC0DEF00D;
+
+                    // A partial unmap splits the page and keeps its neighbours.
+                    mm::vmm::unmap_page(virt + mm::PAGE_SIZE);
+
+                    KTEST_EXPECT(sess, !mm::pde_entry(virt).has_flag(mm::HugePage));
+                    KTEST_EXPECT(sess, mm::vmm::is_mapped(virt));
+                    KTEST_EXPECT(sess, !mm::vmm::is_mapped(virt + mm::PAGE_SIZE));
+                    KTEST_EXPECT(sess, mm::vmm::virt_to_phys(virt + 2 * mm::PAGE_SIZE) == phys + 2 * mm::PAGE_SIZE);
+                    KTEST_EXPECT(sess, *word == 0xC0DEF00D);
+
+                    mm::vmm::unmap_pages(virt, mm::LARGE_PAGE_FRAMES);
+                    KTEST_EXPECT(sess, !mm::vmm::is_mapped(virt));
+                    KTEST_EXPECT(sess, !mm::vmm::is_mapped(virt + mm::LARGE_PAGE_SIZE - mm::PAGE_SIZE));
+                });
+
+            run_case(sess, "vmm-memory-types", [&]() {
+                    if (mm::vmm::pat_enabled)
+                        KTEST_EXPECT(sess, read_msr(mm::vmm::IA32_PAT) == mm::vmm::PAT_VALUE);
+
+                    constexpr uint32_t cache_mask = mm::WriteThrough | mm::CacheDisabled | (1 << 7);
+                    const struct {
+                        mm::MemoryType type;
+                        uint32_t       bits;
+                    } cases[] = {
+                        {mm::MemoryType::WriteBack,      0},
+                        {mm::MemoryType::WriteThrough,   mm::WriteThrough},
+                        {mm::MemoryType::UncachedMinus,  mm::CacheDisabled},
+                        {mm::MemoryType::Uncached,       mm::CacheDisabled | mm::WriteThrough},
+                        {mm::MemoryType::WriteCombining,
+                         mm::vmm::pat_enabled ? (1u << 7) | mm::CacheDisabled | mm::WriteThrough : mm::CacheDisabled},
+                    };
+
+                    const uint32_t     virt  = find_fresh_test_page_base();
+                    const uint32_t     frame = mm::pmm::alloc_frame();
+                    KTEST_ASSERT(sess, frame != 0);
+
+                    for (const auto& c : cases) {
+                        mm::vmm::map_page(virt, frame, mm::Present | mm::Writable, c.type);
+                        KTEST_EXPECT(sess, (mm::pte_entry(virt).value & cache_mask) == c.bits);
+                    }
+
+                    // The directory entry never picks up the PAT bit, which would read as PS.
+                    KTEST_EXPECT(sess, !mm::pde_entry(virt).has_flag(mm::HugePage));
+
+                    mm::vmm::unmap_page(virt);
+                });
+
+            run_case(sess, "vmm-map-alloc", [&]() {
+                    constexpr uint32_t pages = 5;
+
+                    const uint32_t     virt  = find_fresh_test_page_base();
+                    KTEST_ASSERT(sess, mm::vmm::map_alloc(virt, pages, mm::Present | mm::Writable));
+
+                    for (uint32_t i = 0; i < pages; ++i) {
+                        volatile uint32_t* word = reinterpret_cast<volatile uint32_t*>(virt + i * mm::PAGE_SIZE);
+                        *word = 0xA110C000 + i;
+
+                        KTEST_EXPECT(sess, mm::vmm::is_mapped(virt + i * mm::PAGE_SIZE));
+                        KTEST_EXPECT(sess, mm::pmm::frame_used(mm::vmm::virt_to_phys(virt + i * mm::PAGE_SIZE)));
+                    }
+
+                    for (uint32_t i = 0; i < pages; ++i)
+                        KTEST_EXPECT(sess, *reinterpret_cast<volatile uint32_t*>(virt + i * mm::PAGE_SIZE) == 0xA110C000 + i);
+
+                    KTEST_EXPECT(sess, !mm::vmm::is_mapped(virt + pages * mm::PAGE_SIZE));
+
+                    mm::vmm::unmap_pages(virt, pages);
+                    KTEST_EXPECT(sess, !mm::vmm::is_mapped(virt));
+                });
+
+            run_case(sess, "vmm-lazy-fault", [&]() {
+                    const uint32_t virt    = find_fresh_test_page_base();
+                    uint32_t       limit   = virt + 2 * mm::PAGE_SIZE;
+
+                    const auto     below   = [](void* ctx, uint32_t addr) {
+                            return addr < *static_cast<uint32_t*>(ctx);
+                        };
+
+                    KTEST_ASSERT(sess, mm::vmm::reserve_lazy(virt, 4 * mm::PAGE_SIZE, mm::Writable, below, &limit));
+                    KTEST_EXPECT(sess, !mm::vmm::is_mapped(virt));
+
+                    volatile uint32_t* word = reinterpret_cast<volatile uint32_t*>(virt + mm::PAGE_SIZE + 0x10);
+                    KTEST_EXPECT(sess, *word == 0);
+                    *word = 0xFA017ED0;
+
+                    KTEST_EXPECT(sess, mm::vmm::is_mapped(virt + mm::PAGE_SIZE));
+                    KTEST_EXPECT(sess, !mm::vmm::is_mapped(virt));
+                    KTEST_EXPECT(sess, !mm::vmm::is_mapped(virt + 2 * mm::PAGE_SIZE));
+                    KTEST_EXPECT(sess, *word == 0xFA017ED0);
+
+                    mm::vmm::release_lazy(virt);
+                    mm::vmm::unmap_pages(virt, 4);
+                    KTEST_EXPECT(sess, !mm::vmm::is_mapped(virt + mm::PAGE_SIZE));
+                });
+
+            run_case(sess, "vspace-arena", [&]() {
+                    static constexpr mm::layout::virt::RegionDesc region = {
+                        mm::layout::virt::RegionId::VmallocSpace, "ktest-arena", 0x40000000, 64 * mm::PAGE_SIZE,
+                        mm::layout::virt::MapKind::Pool
+                    };
+
+                    constexpr uint32_t guard = mm::VirtualArena::GUARD_PAGES;
+
+                    mm::VirtualArena   arena(region);
+                    KTEST_EXPECT(sess, arena.free_pages() == 64);
+
+                    const uint32_t a = arena.alloc(4);
+                    const uint32_t b = arena.alloc(2);
+                    KTEST_EXPECT(sess, a == region.base);
+                    KTEST_EXPECT(sess, b == a + (4 + guard) * mm::PAGE_SIZE);
+                    KTEST_EXPECT(sess, arena.free_pages() == 64 - (4 + guard) - (2 + guard));
+                    KTEST_EXPECT(sess, arena.allocations() == 2);
+
+                    uint32_t base = 0, pages = 0;
+                    KTEST_EXPECT(sess, arena.lookup(b + 0x10, base, pages));
+                    KTEST_EXPECT(sess, base == b && pages == 2);
+                    KTEST_EXPECT(sess, arena.contains(a + 4 * mm::PAGE_SIZE - 1));
+                    KTEST_EXPECT(sess, !arena.contains(a + 4 * mm::PAGE_SIZE)); // Guard page.
+
+                    // The hole left by `a` is too small, so this lands past `b`.
+                    KTEST_EXPECT(sess, arena.free(a) == 4);
+                    const uint32_t c = arena.alloc(5);
+                    KTEST_EXPECT(sess, c == b + (2 + guard) * mm::PAGE_SIZE);
+
+                    // Freeing `b` merges both holes back into one run at the base.
+                    KTEST_EXPECT(sess, arena.free(b) == 2);
+                    const uint32_t d = arena.alloc(4 + guard + 2);
+                    KTEST_EXPECT(sess, d == region.base);
+
+                    KTEST_EXPECT(sess, arena.alloc(64) == 0);
+                    KTEST_EXPECT(sess, arena.free(region.base + mm::PAGE_SIZE) == 0);
+
+                    arena.free(c);
+                    arena.free(d);
+                    KTEST_EXPECT(sess, arena.free_pages() == 64);
+                    KTEST_EXPECT(sess, arena.allocations() == 0);
+                    KTEST_EXPECT(sess, !arena.contains(d));
+                });
+
+            run_case(sess, "vspace-vmalloc", [&]() {
+                    uint8_t*       buffer = static_cast<uint8_t*>(mm::vmalloc(3 * mm::PAGE_SIZE + 1));
+                    KTEST_ASSERT(sess, buffer != nullptr);
+
+                    const uint32_t base   = reinterpret_cast<uint32_t>(buffer);
+                    KTEST_EXPECT(sess, mm::layout::virt::region<mm::layout::virt::RegionId::VmallocSpace>().contains(base));
+
+                    for (uint32_t i = 0; i < 4; ++i) {
+                        KTEST_EXPECT(sess, mm::vmm::is_mapped(base + i * mm::PAGE_SIZE));
+                        buffer[i * mm::PAGE_SIZE] = static_cast<uint8_t>(0xB0 + i);
+                    }
+
+                    KTEST_EXPECT(sess, !mm::vmm::is_mapped(base + 4 * mm::PAGE_SIZE));
+                    KTEST_EXPECT(sess, buffer[3 * mm::PAGE_SIZE] == 0xB3);
+
+                    mm::vfree(buffer);
+                    KTEST_EXPECT(sess, !mm::vmm::is_mapped(base));
+                    KTEST_EXPECT(sess, !mm::vspace::arena<mm::layout::virt::RegionId::VmallocSpace>().contains(base));
+                });
+
+            run_case(sess, "vspace-vreserve", [&]() {
+                    uint8_t*       buffer = static_cast<uint8_t*>(mm::vreserve(4 * mm::PAGE_SIZE));
+                    KTEST_ASSERT(sess, buffer != nullptr);
+
+                    const uint32_t base   = reinterpret_cast<uint32_t>(buffer);
+                    for (uint32_t i = 0; i < 4; ++i)
+                        KTEST_EXPECT(sess, !mm::vmm::is_mapped(base + i * mm::PAGE_SIZE));
+
+                    buffer[2 * mm::PAGE_SIZE + 7] = 0x5A;
+                    KTEST_EXPECT(sess, mm::vmm::is_mapped(base + 2 * mm::PAGE_SIZE));
+                    KTEST_EXPECT(sess, !mm::vmm::is_mapped(base + mm::PAGE_SIZE));
+                    KTEST_EXPECT(sess, buffer[2 * mm::PAGE_SIZE + 7] == 0x5A);
+                    KTEST_EXPECT(sess, buffer[2 * mm::PAGE_SIZE] == 0);
+
+                    mm::vfree(buffer);
+                    KTEST_EXPECT(sess, !mm::vmm::is_mapped(base + 2 * mm::PAGE_SIZE));
+                });
+
+            run_case(sess, "vmm-lazy-tlb-state", [&]() {
+                    kstd::InterruptGuard guard;
+
+                    smp::Core& core = *smp::CoreManager::current_core();
+                    KTEST_EXPECT(sess, core.tlb_state.load() == mm::TlbState::Active);
+
+                    mm::vmm::enter_lazy_tlb(core);
+                    KTEST_EXPECT(sess, core.tlb_state.load() == mm::TlbState::Lazy);
+                    mm::vmm::leave_lazy_tlb(core);
+                    KTEST_EXPECT(sess, core.tlb_state.load() == mm::TlbState::Active);
+
+                    // A shootdown deferred while parked is paid for on the next wakeup.
+                    mm::vmm::enter_lazy_tlb(core);
+                    core.tlb_state.store(mm::TlbState::LazyFlush);
+                    mm::vmm::leave_lazy_tlb(core);
+                    KTEST_EXPECT(sess, core.tlb_state.load() == mm::TlbState::Active);
+                });
+
             run_case(sess, "heap-reuse-and-alignment", [&]() {
                     Heap& heap    = kernel._heap.get();
 
@@ -692,6 +1391,137 @@ namespace ktest {
                     heap.free(aligned);
                 });
 
+            run_case(sess, "heap-alloc-aligned", [&]() {
+                    Heap&              heap     = kernel._heap.get();
+                    constexpr uint32_t aligns[] = { 16, 64, 256, mm::PAGE_SIZE };
+
+                    for (uint32_t align : aligns) {
+                        void* lead  = heap.alloc(24);
+                        void* block = heap.alloc_aligned(48, align);
+
+                        KTEST_ASSERT(sess, lead != nullptr);
+                        KTEST_ASSERT(sess, block != nullptr);
+                        KTEST_EXPECT(sess, (reinterpret_cast<uint32_t>(block) % align) == 0);
+
+                        memset(reinterpret_cast<uint8_t*>(block), 0x6E, 48);
+                        KTEST_EXPECT(sess, reinterpret_cast<uint8_t*>(block)[47] == 0x6E);
+
+                        heap.free(block);
+                        heap.free(lead);
+                    }
+                });
+
+            run_case(sess, "heap-bin-reuse", [&]() {
+                    Heap&              heap    = kernel._heap.get();
+                    constexpr uint32_t sizes[] = { 24, 200, 0x300, 0x1800 };
+
+                    for (uint32_t size : sizes) {
+                        void* block = heap.alloc(size);
+                        void* guard = heap.alloc(16);
+
+                        KTEST_ASSERT(sess, block != nullptr);
+                        KTEST_ASSERT(sess, guard != nullptr);
+
+                        heap.free(block);
+
+                        void* again = heap.alloc(size);
+                        KTEST_EXPECT(sess, again == block);
+
+                        heap.free(again);
+                        heap.free(guard);
+                    }
+                });
+
+            run_case(sess, "heap-realloc-in-place", [&]() {
+                    Heap&    heap   = kernel._heap.get();
+
+                    uint8_t* block0 = reinterpret_cast<uint8_t*>(heap.alloc(0x200));
+                    void*    block1 = heap.alloc(0x200);
+                    uint8_t* block2 = reinterpret_cast<uint8_t*>(heap.alloc(0x200));
+
+                    KTEST_ASSERT(sess, block0 != nullptr);
+                    KTEST_ASSERT(sess, block1 != nullptr);
+                    KTEST_ASSERT(sess, block2 != nullptr);
+
+                    memset(block0, 0x42, 0x200);
+                    memset(block2, 0x24, 0x200);
+                    heap.free(block1);
+
+                    KTEST_EXPECT(sess, heap.realloc(block0, 0x380) == block0);
+                    KTEST_EXPECT(sess, block0[0] == 0x42 && block0[0x1FF] == 0x42);
+
+                    KTEST_EXPECT(sess, heap.realloc(block0, 0x100) == block0);
+                    KTEST_EXPECT(sess, block0[0xFF] == 0x42);
+
+                    uint8_t* moved = reinterpret_cast<uint8_t*>(heap.realloc(block2, 0x4000));
+                    KTEST_ASSERT(sess, moved != nullptr);
+                    KTEST_EXPECT(sess, moved[0] == 0x24 && moved[0x1FF] == 0x24);
+
+                    heap.free(block0);
+                    heap.free(moved);
+                });
+
+            run_case(sess, "heap-stats", [&]() {
+                    Heap&     heap = kernel._heap.get();
+                    HeapStats before;
+                    HeapStats during;
+                    HeapStats after;
+
+                    heap.stats(before);
+                    KTEST_EXPECT(sess, before.heap_size >= HEAP_MIN_SIZE);
+                    KTEST_EXPECT(sess, before.largest_free_chunk <= before.free_bytes);
+
+                    void* block = heap.alloc(0x400);
+                    KTEST_ASSERT(sess, block != nullptr);
+
+                    heap.stats(during);
+                    KTEST_EXPECT(sess, during.allocs == before.allocs + 1);
+                    KTEST_EXPECT(sess, during.in_use_bytes >= before.in_use_bytes + 0x400);
+                    KTEST_EXPECT(sess, during.peak_bytes >= during.in_use_bytes + during.cached_bytes);
+                    KTEST_EXPECT(sess, during.size_classes[6] == before.size_classes[6] + 1);
+
+                    heap.free(block);
+
+                    heap.stats(after);
+                    KTEST_EXPECT(sess, after.frees == before.frees + 1);
+                    KTEST_EXPECT(sess, after.in_use_bytes == before.in_use_bytes);
+
+                    KTEST_EXPECT(sess, kexp::lookup("kheap_stats") != nullptr);
+                    KTEST_EXPECT(sess, kexp::lookup("kheap_dump") != nullptr);
+
+                    heap.dump();
+                });
+
+            run_case(sess, "heap-cpu-magazine", [&]() {
+                    Heap&              heap  = kernel._heap.get();
+                    constexpr uint32_t count = 24;
+                    uint8_t*           blocks[count];
+
+                    for (uint32_t i = 0; i < count; ++i) {
+                        blocks[i] = reinterpret_cast<uint8_t*>(heap.alloc(40));
+                        KTEST_ASSERT(sess, blocks[i] != nullptr);
+                        memset(blocks[i], static_cast<uint8_t>(i), 40);
+                    }
+
+                    // Odd blocks stay live while even ones cycle through the magazine.
+                    for (uint32_t i = 0; i < count; i += 2)
+                        heap.free(blocks[i]);
+
+                    for (uint32_t i = 0; i < count; i += 2) {
+                        blocks[i] = reinterpret_cast<uint8_t*>(heap.alloc(40));
+                        KTEST_ASSERT(sess, blocks[i] != nullptr);
+                        memset(blocks[i], static_cast<uint8_t>(i), 40);
+                    }
+
+                    bool intact = true;
+                    for (uint32_t i = 0; i < count; ++i) {
+                        intact = intact && blocks[i][0] == i && blocks[i][39] == i;
+                        heap.free(blocks[i]);
+                    }
+
+                    KTEST_EXPECT(sess, intact);
+                });
+
             run_case(sess, "heap-coalesce", [&]() {
                     Heap& heap   = kernel._heap.get();
 
@@ -714,6 +1544,143 @@ namespace ktest {
                     heap.free(block2);
                 });
 
+            run_case(sess, "heap-split-keeps-foot", [&]() {
+                    with_scratch_heap([&](Heap& heap, uint32_t base) {
+                            void* block0 = heap.alloc(0x3F8);
+                            void* block1 = heap.alloc(0x3F8);
+
+                            KTEST_ASSERT(sess, block0 == reinterpret_cast<void*>(base + 8));
+                            KTEST_ASSERT(sess, block1 == reinterpret_cast<void*>(base + 0x408));
+
+                            // Carving block0's hole must update block1's prevFoot to the remainder.
+                            heap.free(block0);
+                            uint8_t* head = reinterpret_cast<uint8_t*>(heap.alloc(0xF8));
+                            KTEST_ASSERT(sess, head == block0);
+                            memset(head, 0x5A, 0xF8);
+
+                            heap.free(block1);
+
+                            void* rest = heap.alloc(0x2F8);
+                            KTEST_EXPECT(sess, rest == head + 0x100);
+                            KTEST_EXPECT(sess, head[0] == 0x5A);
+                            KTEST_EXPECT(sess, head[0xF7] == 0x5A);
+
+                            heap.free(rest);
+                            heap.free(head);
+                        });
+                });
+
+            run_case(sess, "heap-carve-last-chunk", [&]() {
+                    with_scratch_heap([&](Heap& heap, uint32_t base) {
+                            // Takes the whole heap, so no chunk follows to get PINUSE.
+                            void* whole = heap.alloc(HEAP_MIN_SIZE - 8);
+                            KTEST_ASSERT(sess, whole == reinterpret_cast<void*>(base + 8));
+                            KTEST_EXPECT(sess, !mm::vmm::is_mapped(base + HEAP_MIN_SIZE));
+
+                            heap.free(whole);
+
+                            void* again = heap.alloc(HEAP_MIN_SIZE - 8);
+                            KTEST_EXPECT(sess, again == whole);
+                            heap.free(again);
+                        });
+                });
+
+            run_case(sess, "heap-paligned-coalesce", [&]() {
+                    with_scratch_heap([&](Heap& heap, uint32_t base) {
+                            // Leave set bits where the page-aligned chunk's header will land.
+                            void* dirty = heap.alloc(0x2000);
+                            KTEST_ASSERT(sess, dirty == reinterpret_cast<void*>(base + 8));
+                            memset(reinterpret_cast<uint8_t*>(dirty), 0xFF, 0x2000);
+                            heap.free(dirty);
+
+                            void* aligned = heap.palignedAlloc(0x100);
+                            KTEST_ASSERT(sess, aligned == reinterpret_cast<void*>(base + mm::PAGE_SIZE));
+
+                            // Freeing it must fold the lead chunk back in front of it.
+                            heap.free(aligned);
+
+                            void* block = heap.alloc(0x1000);
+                            KTEST_EXPECT(sess, block == dirty);
+                            heap.free(block);
+                        });
+                });
+
+            run_case(sess, "heap-free-sub-page-tail", [&]() {
+                    with_scratch_heap([&](Heap& heap, uint32_t base) {
+                            void* whole = heap.alloc(HEAP_MIN_SIZE - 8);
+                            KTEST_ASSERT(sess, whole == reinterpret_cast<void*>(base + 8));
+
+                            // Shrinking by one minimum chunk frees a tail that starts inside the last page.
+                            KTEST_EXPECT(sess, heap.realloc(whole, HEAP_MIN_SIZE - 24) == whole);
+
+                            HeapStats stats;
+                            heap.stats(stats);
+                            KTEST_EXPECT(sess, stats.heap_size == HEAP_MIN_SIZE);
+                            KTEST_EXPECT(sess, stats.free_chunks == 1);
+
+                            heap.free(whole);
+                        });
+                });
+
+            run_case(sess, "slab-cache-hooks-and-release", [&]() {
+                    static mm::SlabCache cache("ktest-slab", 24, 8,
+                        [](void* object) {
+                            ++state().slab_ctor_count;
+                            *reinterpret_cast<uint32_t*>(object) = 0x51AB51AB;
+                        },
+                        [](void*) {
+                            ++state().slab_dtor_count;
+                        });
+
+                    const uint32_t     ctor_before = state().slab_ctor_count;
+                    const uint32_t     dtor_before = state().slab_dtor_count;
+                    constexpr uint32_t count       = 64;
+                    void*              objects[count];
+
+                    for (auto& object : objects) {
+                        object = cache.alloc();
+                        KTEST_ASSERT(sess, object != nullptr);
+                        KTEST_EXPECT(sess, mm::SlabCache::owns(object));
+                        KTEST_EXPECT(sess, (reinterpret_cast<uint32_t>(object) & 7) == 0);
+                        KTEST_EXPECT(sess, *reinterpret_cast<uint32_t*>(object) == 0x51AB51AB);
+                    }
+
+                    KTEST_EXPECT(sess, cache.active_objects() == count);
+                    KTEST_EXPECT(sess, state().slab_ctor_count - ctor_before ==
+                        cache.slab_count() * cache.objects_per_slab());
+
+                    cache.free(objects[7]);
+                    KTEST_EXPECT(sess, cache.alloc() == objects[7]);
+
+                    for (auto object : objects)
+                        cache.free(object);
+
+                    KTEST_EXPECT(sess, cache.active_objects() == 0);
+
+                    cache.shrink();
+                    KTEST_EXPECT(sess, cache.slab_count() == 0);
+                    KTEST_EXPECT(sess, state().slab_dtor_count - dtor_before == state().slab_ctor_count - ctor_before);
+                });
+
+            run_case(sess, "object-cache", [&]() {
+                    static kstd::ObjectCache<RawLifetimeProbe> cache("ktest-object");
+
+                    const uint32_t ctor_before = state().raw_ctor_count;
+                    const uint32_t dtor_before = state().raw_dtor_count;
+
+                    RawLifetimeProbe* probe    = cache.create(0x0B1EC700u);
+                    KTEST_ASSERT(sess, probe != nullptr);
+                    KTEST_EXPECT(sess, probe->magic == 0x0B1EC700);
+                    KTEST_EXPECT(sess, mm::SlabCache::owns(probe));
+
+                    cache.destroy(probe);
+                    KTEST_EXPECT(sess, state().raw_ctor_count == ctor_before + 1);
+                    KTEST_EXPECT(sess, state().raw_dtor_count == dtor_before + 1);
+
+                    cache.cache().shrink();
+                    KTEST_EXPECT(sess, cache.cache().slab_count() == 0);
+                });
+
             sess.end_suite();
         }
 
@@ -726,8 +1693,9 @@ namespace ktest {
                     state().task1_finished = false;
                     state().task2_finished = false;
 
-                    kernel._sched.get().create_task("ktest-task1", task1_entry);
-                    kernel._sched.get().create_task("ktest-task2", task2_entry);
+                    sched::Scheduler& local = smp::CoreManager::current_core()->scheduler();
+                    local.create_task("ktest-task1", task1_entry);
+                    local.create_task("ktest-task2", task2_entry);
 
                     pit::sleep_us(250 * 1000);
 
@@ -737,6 +1705,211 @@ namespace ktest {
                     KTEST_EXPECT(sess, state().task2_runs >= 1);
                 });
 
+            run_case(sess, "task-own-stack", [&]() {
+                    state().own_stack_runs.store(0);
+
+                    sched::Scheduler& local = smp::CoreManager::current_core()->scheduler();
+                    for (uint32_t i = 0; i < 3; i++)
+                        local.create_task("ktest-stack", own_stack_task_entry);
+
+                    pit::sleep_us(200 * 1000);
+
+                    KTEST_EXPECT(sess, state().own_stack_runs.load() == 3);
+                });
+
+            run_case(sess, "task-priority", [&]() {
+                    sched::Scheduler&   local  = smp::CoreManager::current_core()->scheduler();
+                    sched::BalanceStats before = {};
+                    sched::BalanceStats after  = {};
+
+                    state().urgent_runs.store(0);
+                    local.balance_stats(before);
+
+                    local.create_task("ktest-urgent", urgent_task_entry, sched::DEFAULT_PRIORITY + 4);
+                    local.yield();
+
+                    // The yielding task only gets the core back once the urgent one is done, unless a peer took it.
+                    local.balance_stats(after);
+                    if (after.stolen == before.stolen)
+                        KTEST_EXPECT(sess, state().urgent_runs.load() == 1);
+
+                    pit::sleep_us(50 * 1000);
+                    KTEST_EXPECT(sess, state().urgent_runs.load() == 1);
+                });
+
+            run_case(sess, "task-sleep", [&]() {
+                    state().sleep_ticks.store(0);
+
+                    sched::Scheduler::spawn("ktest-sleeper", sleeper_task_entry);
+                    sched::sleep_for(150 * 1000);
+
+                    KTEST_EXPECT(sess, state().sleep_ticks.load() >= 30 * 1000 / pit::interval());
+                });
+
+            run_case(sess, "wait-queue", [&]() {
+                    state().event_ready.store(0);
+                    state().event_waiters_done.store(0);
+
+                    sched::Scheduler::spawn("ktest-waiter", event_waiter_entry);
+                    sched::Scheduler::spawn("ktest-waiter", event_waiter_entry);
+                    sched::sleep_for(50 * 1000);
+
+                    KTEST_EXPECT(sess, state().event_waiters_done.load() == 0);
+
+                    // Waiters that have not parked yet see the flag; parked ones need the wakeup.
+                    state().event_ready.store(1);
+                    event_queue().wake_all();
+                    sched::sleep_for(100 * 1000);
+
+                    KTEST_EXPECT(sess, state().event_waiters_done.load() == 2);
+                    KTEST_EXPECT(sess, event_queue().empty());
+                });
+
+            run_case(sess, "mutex", [&]() {
+                    sched::Mutex& mutex = sync_mutex();
+
+                    mutex.lock();
+                    KTEST_EXPECT(sess, mutex.held());
+                    KTEST_EXPECT(sess, !mutex.try_lock());
+                    mutex.unlock();
+                    KTEST_EXPECT(sess, !mutex.held());
+
+                    state().mutex_counter = 0;
+                    state().mutex_tasks_done.store(0);
+
+                    for (uint32_t i = 0; i < MUTEX_TASKS; i++)
+                        sched::Scheduler::spawn("ktest-mutex", mutex_task_entry);
+
+                    for (uint32_t i = 0; i < 200 && state().mutex_tasks_done.load() < MUTEX_TASKS; i++)
+                        sched::sleep_for(10 * 1000);
+
+                    KTEST_EXPECT(sess, state().mutex_tasks_done.load() == MUTEX_TASKS);
+                    KTEST_EXPECT(sess, state().mutex_counter == MUTEX_TASKS * MUTEX_ITERATIONS);
+                    KTEST_EXPECT(sess, !mutex.held());
+                });
+
+            run_case(sess, "semaphore", [&]() {
+                    sched::Semaphore  single(1);
+                    sched::Semaphore& shared = sync_semaphore();
+
+                    KTEST_EXPECT(sess, single.try_acquire());
+                    KTEST_EXPECT(sess, !single.try_acquire());
+                    single.release();
+                    KTEST_EXPECT(sess, single.count() == 1);
+
+                    state().sem_acquired.store(0);
+
+                    for (uint32_t i = 0; i < 3; i++)
+                        sched::Scheduler::spawn("ktest-sem", semaphore_task_entry);
+
+                    sched::sleep_for(30 * 1000);
+                    KTEST_EXPECT(sess, state().sem_acquired.load() == 0);
+
+                    for (uint32_t i = 0; i < 3; i++)
+                        shared.release();
+
+                    sched::sleep_for(100 * 1000);
+                    KTEST_EXPECT(sess, state().sem_acquired.load() == 3);
+                    KTEST_EXPECT(sess, shared.count() == 0);
+                });
+
+            run_case(sess, "condvar", [&]() {
+                    state().cond_ready = false;
+                    state().cond_woken.store(0);
+
+                    sched::Scheduler::spawn("ktest-cond", condvar_task_entry);
+                    sched::Scheduler::spawn("ktest-cond", condvar_task_entry);
+
+                    sched::sleep_for(30 * 1000);
+                    KTEST_EXPECT(sess, state().cond_woken.load() == 0);
+
+                    {
+                        sched::MutexGuard guard(sync_mutex());
+                        state().cond_ready = true;
+                    }
+                    sync_condvar().notify_all();
+
+                    sched::sleep_for(100 * 1000);
+                    KTEST_EXPECT(sess, state().cond_woken.load() == 2);
+                });
+
+            run_case(sess, "task-placement", [&]() {
+                    smp::CoreManager* cores   = kernel._cmanager.ptr_if_constructed();
+                    uint32_t          running = 0;
+
+                    KTEST_ASSERT(sess, cores != nullptr);
+
+                    for (uint32_t i = 0; i < cores->core_count(); i++) {
+                        smp::Core& core = cores->core(i);
+                        if (core.has_scheduler() && core.scheduler().is_initialized())
+                            ++running;
+                    }
+
+                    KTEST_ASSERT(sess, running >= 1 && running <= 32);
+
+                    state().placed_runs.store(0);
+                    state().placed_cores.store(0);
+
+                    // Two per core: the least-loaded policy must reach every running core.
+                    for (uint32_t i = 0; i < running * 2; i++)
+                        sched::Scheduler::spawn("ktest-placed", placed_task_entry);
+
+                    pit::sleep_us(250 * 1000);
+
+                    KTEST_EXPECT(sess, state().placed_runs.load() == running * 2);
+
+                    uint32_t reached = 0;
+                    for (uint32_t mask = state().placed_cores.load(); mask; mask &= mask - 1)
+                        ++reached;
+
+                    KTEST_EXPECT(sess, reached == running);
+                });
+
+            run_case(sess, "work-stealing", [&]() {
+                    smp::CoreManager* cores = kernel._cmanager.ptr_if_constructed();
+                    KTEST_ASSERT(sess, cores != nullptr);
+
+                    smp::Core&          local  = *smp::CoreManager::current_core();
+                    uint32_t            peers  = 0;
+                    uint32_t            steals = 0;
+                    sched::BalanceStats before = {};
+                    sched::BalanceStats after  = {};
+
+                    local.scheduler().balance_stats(before);
+                    state().queued_runs.store(0);
+                    state().queued_same_task.store(0);
+
+                    // Queue everything locally; idle peers have to come and take it.
+                    constexpr uint32_t queued = 4;
+                    for (uint32_t i = 0; i < queued; i++)
+                        state().queued_tasks[i].store(&local.scheduler().create_task("ktest-queued", queued_task_entry));
+
+                    pit::sleep_us(250 * 1000);
+
+                    KTEST_EXPECT(sess, state().queued_runs.load() == queued);
+                    KTEST_EXPECT(sess, state().queued_same_task.load() == queued);
+
+                    for (uint32_t i = 0; i < cores->core_count(); i++) {
+                        smp::Core& core = cores->core(i);
+                        if (&core == &local || !core.has_scheduler() || !core.scheduler().is_initialized())
+                            continue;
+
+                        sched::BalanceStats stats;
+                        core.scheduler().balance_stats(stats);
+                        steals += stats.idle_steals + stats.rebalance_steals;
+                        ++peers;
+                    }
+
+                    local.scheduler().balance_stats(after);
+
+                    if (peers) {
+                        KTEST_EXPECT(sess, steals > 0);
+                        KTEST_EXPECT(sess, after.stolen > before.stolen);
+                    } else {
+                        KTEST_EXPECT(sess, after.stolen == before.stolen);
+                    }
+                });
+
             sess.end_suite();
         }
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <klibcpp/bitmap.hpp>
+#include <klibcpp/buddy.hpp>
 #include <klibcpp/atomic.hpp>
 #include <klibcpp/memory.hpp>
 #include <klibcpp/spinlock.hpp>
@@ -9,17 +10,20 @@
 #include <klibcpp/trivial.hpp>
 #include <klibcpp/type_traits.hpp>
 #include <klibcpp/utility.hpp>
+#include <klibabi/kapi.hpp>
 
 #include <int/idt.hpp>
 #include <mm/heap.hpp>
 #include <mm/layout.hpp>
 #include <mm/pmm.hpp>
 #include <mm/vmm.hpp>
+#include <sched/scheduler.hpp>
 #include <sys/smp.hpp>
 
 namespace ktest {
     namespace compile_time {
         using TinyBitmap = FixedBitmapAllocator<0x1000, 64, 0x1000>;
+        using TinyBuddy  = FixedBuddyAllocator<0x1000, 64, 0x1000, 3>;
         using Seq4       = kstd::make_index_sequence<4>;
 
         template<typename T>
@@ -48,6 +52,7 @@ namespace ktest {
         static_assert(!kstd::is_base_of_v<BaseType, UnrelatedType>);
 
         static_assert(kstd::is_base_of_v<NonTransferable, TinyBitmap>);
+        static_assert(kstd::is_base_of_v<NonTransferable, TinyBuddy>);
         static_assert(kstd::is_base_of_v<NonTransferable, kstd::Atomic<uint32_t> >);
         static_assert(kstd::is_base_of_v<NonTransferable, kstd::Atomic<uint64_t> >);
         static_assert(kstd::is_base_of_v<NonTransferable, kstd::SpinLock>);
@@ -58,6 +63,13 @@ namespace ktest {
         static_assert(TinyBitmap::MAX_UNITS == 64);
         static_assert(TinyBitmap::UNIT_SIZE == 0x1000);
         static_assert(TinyBitmap::BITMAP_SIZE == 2);
+        static_assert(TinyBuddy::ORDERS == 4);
+        static_assert(TinyBuddy::order_offset(0) == 0);
+        static_assert(TinyBuddy::order_offset(1) == 64);
+        static_assert(TinyBuddy::order_offset(4) == 120);
+        static_assert(TinyBuddy::order_for(1) == 0);
+        static_assert(TinyBuddy::order_for(3) == 2);
+        static_assert(TinyBuddy::order_for(8) == 3);
         static_assert(mm::PMM::BASE_ADDR == 0);
         static_assert(mm::PMM::MAX_UNITS == mm::MAX_FRAMES);
         static_assert(mm::PMM::UNIT_SIZE == mm::PAGE_SIZE);
@@ -75,6 +87,8 @@ namespace ktest {
         static_assert(mm::PT_BASE == 0xFFC00000);
         static_assert(mm::PAGE_MASK == 0xFFFFF000);
         static_assert(sizeof(mm::Entry) == 4);
+        // The recursive view of a large PDE selects PA4..PA7, which must match PA0..PA2.
+        static_assert((mm::vmm::PAT_VALUE >> 32 & 0xFFFFFF) == (mm::vmm::PAT_VALUE & 0xFFFFFF));
         static_assert(sizeof(HeapChunk_t) == 16);
         static_assert(mm::layout::virt::validate());
         static_assert(mm::layout::virt::region<mm::layout::virt::RegionId::KernelHeap>().id ==
@@ -88,8 +102,18 @@ namespace ktest {
         static_assert(mm::layout::virt::region<mm::layout::virt::RegionId::KernelHeap>().contains(HEAP_START));
         static_assert(mm::layout::virt::region<mm::layout::virt::RegionId::KernelHeap>().contains(HEAP_START,
             HEAP_MIN_SIZE));
+        static_assert(mm::layout::virt::region<mm::layout::virt::RegionId::SlabSpace>().base ==
+            mm::layout::virt::SLAB_SPACE_BASE);
         static_assert(mm::layout::virt::region<mm::layout::virt::RegionId::ModuleSpace>().base ==
             mm::layout::virt::MODULE_SPACE_BASE);
+        static_assert(mm::layout::virt::region<mm::layout::virt::RegionId::VmallocSpace>().base ==
+            mm::layout::virt::VMALLOC_SPACE_BASE);
+        static_assert(mm::layout::virt::region<mm::layout::virt::RegionId::VmallocSpace>().kind ==
+            mm::layout::virt::MapKind::Pool);
+        static_assert(mm::layout::virt::region<mm::layout::virt::RegionId::ScratchSlots>().base ==
+            mm::layout::virt::SCRATCH_BASE);
+        static_assert(mm::layout::virt::SCRATCH_SLOT_COUNT >=
+            smp::CoreManager::MAX_CORES * mm::layout::virt::SCRATCH_SLOTS_PER_CORE);
         static_assert(mm::layout::virt::region<mm::layout::virt::RegionId::RecursivePageTables>().base == mm::PT_BASE);
         static_assert(mm::layout::boot::LOW_USABLE_BASE == 0x00100000);
         static_assert(mm::layout::boot::ACPI_SCAN_BASE == 0x000E0000);
@@ -105,10 +129,18 @@ namespace ktest {
         static_assert(idt::get_isr_wrapper<14>().has_error_code);
         static_assert(idt::get_isr_wrapper<14>().kind == idt::InterruptFrameKind::Base);
         static_assert(idt::get_isr_wrapper<32>().kind == idt::InterruptFrameKind::ContextSwitch);
-        static_assert(idt::get_isr_wrapper<48>().kind == idt::InterruptFrameKind::ContextSwitch);
+        static_assert(idt::get_isr_wrapper<sched::Scheduler::YIELD_VECTOR>().kind == idt::InterruptFrameKind::ContextSwitch);
+        static_assert(idt::get_isr_wrapper<sched::Scheduler::TICK_VECTOR>().kind == idt::InterruptFrameKind::ContextSwitch);
+        static_assert(sched::PRIORITY_LEVELS <= 32, "the ready bitmap is one 32-bit word");
+        static_assert(sched::IDLE_PRIORITY < sched::DEFAULT_PRIORITY && sched::DEFAULT_PRIORITY < sched::PRIORITY_LEVELS);
         static_assert(idt::get_isr_wrapper<mm::vmm::TLB_SHOOTDOWN_VECTOR>().kind == idt::InterruptFrameKind::Base);
         static_assert(!idt::get_isr_wrapper<3>().has_error_code);
 
+        // Modules index KernelAPI by offset; new entries only ever go at the end.
+        static_assert(__builtin_offsetof(KernelAPI, get_ticks) == 8);
+        static_assert(__builtin_offsetof(KernelAPI, getc) == 20);
+        static_assert(__builtin_offsetof(KernelAPI, krealloc) == 24);
+
         static_assert(sizeof(smp::StackAnchor) == 16);
         static_assert(sizeof(smp::BaseCoreStack) == CORE_STACK_SIZE);
         static_assert(alignof(smp::BaseCoreStack) == CORE_STACK_SIZE);
@@ -3,7 +3,9 @@
 #include <klibcpp/cstdint.hpp>
 #include <klibcpp/spinlock.hpp>
 #include <klibcpp/cllist.hpp>
+#include <klibabi/kheap.hpp>
 #include <mm/layout.hpp>
+#include <sys/smp.hpp>
 
 inline constexpr uint32_t HEAP_START    = mm::layout::virt::KERNEL_HEAP_BASE;
 inline constexpr uint32_t HEAP_MIN_SIZE = mm::layout::virt::KERNEL_HEAP_INITIAL_SIZE;
@@ -17,26 +19,104 @@ typedef	struct {
 
 class Heap {
     public:
-        Heap(uint32_t start, uint32_t size, uint32_t max, uint16_t perms);
+        /*
+            A lazy heap reserves [start, max) with the VMM instead of mapping
+            it: pages below the current end are backed on first touch, so an
+            expand costs no physical memory until the new chunks are used.
+        */
+        Heap(uint32_t start, uint32_t size, uint32_t max, uint16_t perms, bool lazy = false);
         ~Heap() = default;
 
         void*        alloc(uint32_t size);
         void*        palignedAlloc(uint32_t size);
+        void*        alloc_aligned(uint32_t size, uint32_t align);
         void         free(void* p);
+        void*        realloc(void* p, uint32_t size);
 
         uint32_t     malloc(uint32_t size, uint8_t align);
         void         mfree(void* p);
         void         expand(size_t newSize);
         size_t       contract(size_t newSize);
 
+        void         stats(HeapStats& out);
+        void         dump();
+
     private:
+        /*
+            Free chunks below 256 bytes live in exact-size small bins (one per
+            8-byte step). Larger ones go to large bins, two per power of two,
+            each kept sorted by size. smallmap/largemap flag non-empty bins.
+        */
+        static constexpr uint32_t NSMALLBINS = 32;
+        static constexpr uint32_t NLARGEBINS = 32;
+
+        /*
+            Per-core magazines of freed small chunks, one per small bin. Cached
+            chunks stay marked in use, so the bins and coalescing never see
+            them; alloc()/free() only take the heap lock to move a batch.
+        */
+        struct Counters {
+            uint32_t allocs;
+            uint32_t frees;
+            uint32_t sizeClasses[HEAP_STATS_SIZE_CLASSES];
+        };
+
+        struct CpuCache {
+            static constexpr uint32_t MAGAZINE_SIZE = 8;
+            static constexpr uint32_t BATCH         = MAGAZINE_SIZE / 2;
+
+            struct Magazine {
+                uint32_t     count;
+                HeapChunk_t* chunks[MAGAZINE_SIZE];
+            };
+
+            Magazine classes[NSMALLBINS];
+            Counters counters;
+        };
+
+        /*
+            Every acquisition of `lock`, with interrupts off. A contract unmaps
+            pages under the lock and waits for every core to flush its TLB, so
+            a core spinning here answers the shootdown itself.
+        */
+        class LockGuard : public NonTransferable {
+            public:
+                explicit LockGuard(kstd::SpinLock& lock)
+                    : lock_(lock) {
+                    while (!lock_.try_lock()) {
+                        mm::vmm::answer_shootdown();
+                        __pause;
+                    }
+                }
+
+                ~LockGuard() {
+                    lock_.unlock();
+                }
+
+            private:
+                kstd::InterruptGuard interrupt_guard_;
+                kstd::SpinLock&      lock_;
+        };
+
+        static uint32_t largeBinIndex(size_t size);
+        static void     countAlloc(Counters& counters, size_t size);
+        static bool     backsAddress(void* heap, uint32_t addr);
+
+        void         accountInUse(size_t added, size_t removed);
+        uint32_t     largestFreeChunk();
+
+        CpuCache*    localCache();
+        void         refillMagazine(CpuCache::Magazine& mag, size_t size);
+        void         flushMagazine(CpuCache::Magazine& mag);
+
         HeapChunk_t* findSmallestChunk(size_t size);
         void         insertChunk(HeapChunk_t* chunk);
         void         removeChunk(HeapChunk_t* chunk);
 
         void*        alloc_unlocked(size_t size);
-        void*        palignedAlloc_unlocked(size_t size);
+        void*        alloc_aligned_unlocked(size_t size, size_t align);
         void         free_unlocked(void* p);
+        bool         resize_unlocked(HeapChunk_t* block, size_t nb);
         void         expand_unlocked(size_t newSize);
         size_t       contract_unlocked(size_t newSize);
 
@@ -44,9 +124,27 @@ class Heap {
         uint32_t endAddr;
         uint32_t maxAddr;
         uint16_t perms;
+        bool     lazy;
         kstd::SpinLock lock;
-        struct	list_head head;
+        uint32_t smallmap;
+        uint32_t largemap;
+        // The free chunk that ended at endAddr when it was binned, so growing the heap can extend it.
+        HeapChunk_t* top;
+        struct	list_head smallbins[NSMALLBINS];
+        struct	list_head largebins[NLARGEBINS];
+        CpuCache* cpuCaches[smp::CoreManager::MAX_CORES];
+
+        // Maintained under `lock`; the per-core caches keep their own Counters.
+        Counters counters;
+        uint32_t reallocs;
+        uint32_t expands;
+        uint32_t contracts;
+        uint32_t inUseBytes;
+        uint32_t peakBytes;
+        uint32_t freeBytes;
+        uint32_t freeChunks;
 };
 
-uint32_t heap_malloc(Heap* heap, uint32_t size, uint8_t align);
+uint32_t heap_malloc(Heap* heap, uint32_t size, uint32_t align);
 void     heap_free(Heap* heap, void* addr);
+void*    heap_realloc(Heap* heap, void* addr, uint32_t size);
@@ -10,13 +10,18 @@ namespace mm {
             inline constexpr uint32_t ACPI_SCAN_BASE  = 0x000E0000;
             inline constexpr uint32_t ACPI_SCAN_END   = 0x00100000;
             inline constexpr uint32_t LOW_USABLE_BASE = 0x00100000;
+            inline constexpr uint32_t VGA_TEXT_BASE   = 0x000B8000;
+            inline constexpr uint32_t VGA_TEXT_SIZE   = 0x00008000;
         }
 
         namespace virt {
             enum class RegionId : uint8_t {
                 BootstrapIdentity,
                 KernelHeap,
+                SlabSpace,
                 ModuleSpace,
+                VmallocSpace,
+                ScratchSlots,
                 RecursivePageTables,
             };
 
@@ -57,10 +62,25 @@ namespace mm {
             inline constexpr uint32_t   KERNEL_HEAP_SIZE         = 0x01000000;
             inline constexpr uint32_t   KERNEL_HEAP_INITIAL_SIZE = 0x00100000;
 
+            inline constexpr uint32_t   SLAB_SPACE_BASE          = 0x02000000;
+            inline constexpr uint32_t   SLAB_SPACE_SIZE          = 0x01000000;
+            inline constexpr uint32_t   SLAB_SPACE_PAGE_COUNT    = SLAB_SPACE_SIZE / PAGE_SIZE;
+
             inline constexpr uint32_t   MODULE_SPACE_BASE        = 0x0A000000;
             inline constexpr uint32_t   MODULE_SPACE_SIZE        = 0x00080000;
             inline constexpr uint32_t   MODULE_SPACE_PAGE_COUNT  = MODULE_SPACE_SIZE / PAGE_SIZE;
 
+            // General-purpose kernel virtual ranges, handed out by mm::vmalloc().
+            inline constexpr uint32_t   VMALLOC_SPACE_BASE       = 0x10000000;
+            inline constexpr uint32_t   VMALLOC_SPACE_SIZE       = 0x10000000;
+
+            // A few pages per core for short-lived, core-local mappings of arbitrary
+            // frames. The page table behind it is allocated in vmm::init().
+            inline constexpr uint32_t   SCRATCH_BASE             = 0xFF800000;
+            inline constexpr uint32_t   SCRATCH_SIZE             = 0x00400000;
+            inline constexpr uint32_t   SCRATCH_SLOT_COUNT       = SCRATCH_SIZE / PAGE_SIZE;
+            inline constexpr uint32_t   SCRATCH_SLOTS_PER_CORE   = 4;
+
             inline constexpr uint32_t   RECURSIVE_PT_BASE        = 0xFFC00000;
             inline constexpr uint32_t   RECURSIVE_PT_SIZE        = 0x00400000;
             inline constexpr uint32_t   RECURSIVE_PD_BASE        = RECURSIVE_PT_BASE + RECURSIVE_PT_SIZE - PAGE_SIZE;
@@ -69,7 +89,10 @@ namespace mm {
                 {RegionId::BootstrapIdentity, "bootstrap-identity", IDENTITY_WINDOW_BASE, IDENTITY_WINDOW_SIZE,
                  MapKind::Identity},
                 {RegionId::KernelHeap, "kernel-heap", KERNEL_HEAP_BASE, KERNEL_HEAP_SIZE, MapKind::Pool},
+                {RegionId::SlabSpace, "slab-space", SLAB_SPACE_BASE, SLAB_SPACE_SIZE, MapKind::Pool},
                 {RegionId::ModuleSpace, "module-space", MODULE_SPACE_BASE, MODULE_SPACE_SIZE, MapKind::Pool},
+                {RegionId::VmallocSpace, "vmalloc-space", VMALLOC_SPACE_BASE, VMALLOC_SPACE_SIZE, MapKind::Pool},
+                {RegionId::ScratchSlots, "scratch-slots", SCRATCH_BASE, SCRATCH_SIZE, MapKind::Fixed},
                 {RegionId::RecursivePageTables, "recursive-page-tables", RECURSIVE_PT_BASE, RECURSIVE_PT_SIZE,
                  MapKind::Reserved},
             };
@@ -90,15 +113,30 @@ namespace mm {
             };
 
             template<>
-            struct RegionIndex<RegionId::ModuleSpace> {
+            struct RegionIndex<RegionId::SlabSpace> {
                 static constexpr size_t value = 2;
             };
 
             template<>
-            struct RegionIndex<RegionId::RecursivePageTables> {
+            struct RegionIndex<RegionId::ModuleSpace> {
                 static constexpr size_t value = 3;
             };
 
+            template<>
+            struct RegionIndex<RegionId::VmallocSpace> {
+                static constexpr size_t value = 4;
+            };
+
+            template<>
+            struct RegionIndex<RegionId::ScratchSlots> {
+                static constexpr size_t value = 5;
+            };
+
+            template<>
+            struct RegionIndex<RegionId::RecursivePageTables> {
+                static constexpr size_t value = 6;
+            };
+
             constexpr bool is_page_aligned(uint32_t value) {
                 return (value & (PAGE_SIZE - 1)) == 0;
             }
@@ -158,7 +196,9 @@ namespace mm {
             static_assert(KERNEL_HEAP_INITIAL_SIZE <= KERNEL_HEAP_SIZE);
             static_assert(RECURSIVE_PT_SIZE == (1024u * PAGE_SIZE));
             static_assert(RECURSIVE_PD_BASE == 0xFFFFF000);
+            static_assert(SCRATCH_SIZE == (1024u * PAGE_SIZE), "scratch slots must fit one page table");
             static_assert(MODULE_SPACE_PAGE_COUNT == (MODULE_SPACE_SIZE / PAGE_SIZE));
+            static_assert(SLAB_SPACE_PAGE_COUNT == (SLAB_SPACE_SIZE / PAGE_SIZE));
             static_assert(validate(), "virtual memory layout must be page-aligned and non-overlapping");
         }
     }
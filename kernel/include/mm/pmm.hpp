@@ -6,6 +6,7 @@
 
 #include <klibcpp/cstdint.hpp>
 #include <klibcpp/bitmap.hpp>
+#include <klibcpp/buddy.hpp>
 #include <klibcpp/spinlock.hpp>
 #include <multiboot.hpp>
 
@@ -16,12 +17,27 @@ namespace mm {
     static constexpr uint32_t PAGE_SIZE  = 4096;
     static constexpr uint32_t MAX_FRAMES = 1 << 20;
 
+#if defined(KERNEL_PMM_BUDDY)
+    static constexpr uint32_t PMM_MAX_ORDER = 10;
+
+    using PMM = FixedBuddyAllocator<
+        0x00000000,
+        MAX_FRAMES,
+        mm::PAGE_SIZE,
+        PMM_MAX_ORDER
+    >;
+
+    static constexpr const char* PMM_BACKEND_NAME = "buddy";
+#else
     using PMM = FixedBitmapAllocator<
         0x00000000,
         MAX_FRAMES,
         mm::PAGE_SIZE
     >;
 
+    static constexpr const char* PMM_BACKEND_NAME = "bitmap";
+#endif
+
     constexpr inline uint32_t align_down(uint32_t val, uint32_t align) {
         return val & ~(align - 1);
     }
@@ -30,12 +46,62 @@ namespace mm {
         return (val + align - 1) & ~(align - 1);
     }
 
+    /*
+        Per-core single-frame cache. `hot` serves alloc_frame()/free_frame();
+        `cold` is always either empty or full and gets swapped in before the
+        global allocator is touched, so refill and drain move whole magazines
+        under one lock acquisition. Frames parked in a cache still read as used
+        through frame_used(). `lock` is uncontended on the owning core; another
+        core only takes it to reclaim the cache when the allocator runs dry.
+    */
+    struct alignas(64) FrameCache {
+        static constexpr uint32_t MAGAZINE_SIZE = 16;
+
+        struct Magazine {
+            uint32_t count = 0;
+            uint32_t frames[MAGAZINE_SIZE] = {};
+
+            bool empty() const {
+                return count == 0;
+            }
+
+            bool full() const {
+                return count == MAGAZINE_SIZE;
+            }
+        };
+
+        Magazine*      hot;
+        Magazine*      cold;
+        Magazine       magazines[2];
+        kstd::SpinLock lock;
+
+        FrameCache() : hot(&magazines[0]), cold(&magazines[1]) {}
+
+        void swap() {
+            Magazine* tmp = hot;
+            hot  = cold;
+            cold = tmp;
+        }
+
+        uint32_t cached() const {
+            return magazines[0].count + magazines[1].count;
+        }
+    };
+
+    // Frames kept cleared ahead of time for alloc_zeroed_frame().
+    static constexpr uint32_t ZERO_POOL_SIZE = 64;
+
     class pmm {
         public:
             static void     init(multiboot_info_t* mboot);
             static uint32_t alloc_frame();
             static void     free_frame(uint32_t addr);
+            static uint32_t alloc_zeroed_frame();
+            static uint32_t prezero_frames(uint32_t budget);
+            static void     zero_frame(uint32_t addr);
             static uint32_t alloc_frames(uint32_t count);
+            // Best-effort run of at most `max` frames; `count` is 0 when out of memory.
+            static uint32_t alloc_frames_upto(uint32_t max, uint32_t& count);
             static void     free_frames(uint32_t base, uint32_t count);
             static bool     frame_used(uint32_t addr);
             static uint32_t free_memory();
@@ -49,6 +115,16 @@ namespace mm {
             static uint32_t available_frames;
             static uint32_t used_frames;
 
+            static kstd::SpinLock zero_lock;
+            static uint32_t       zeroed_count;
+            static uint32_t       zeroed[ZERO_POOL_SIZE];
+
+            static FrameCache* local_cache();
+            static uint32_t    cached_frames();
+            static bool        refill(FrameCache::Magazine& mag);
+            static void        drain(FrameCache::Magazine& mag);
+            static uint32_t    reclaim_cached();
+
             static void     init_region(uint32_t base, size_t size);
             static void     deinit_region(uint32_t base, size_t size);
     };
@@ -0,0 +1,153 @@
+/*
+    This file contains implementation of
+    OS++ slab object caches.
+*/
+#pragma once
+
+#include <klibcpp/cstdint.hpp>
+#include <klibcpp/spinlock.hpp>
+#include <klibcpp/trivial.hpp>
+#include <mm/layout.hpp>
+#include <sys/smp.hpp>
+
+namespace mm {
+    struct Slab;
+
+    /*
+        Per-core object cache, shaped like FrameCache: `hot` serves alloc()
+        and free(), `cold` is swapped in before the cache lock is touched, so
+        refill and flush move a whole batch under one lock acquisition.
+    */
+    struct SlabCpuCache {
+        static constexpr uint32_t MAGAZINE_SIZE = 16;
+
+        struct Magazine {
+            uint32_t count = 0;
+            void*    objects[MAGAZINE_SIZE] = {};
+        };
+
+        Magazine* hot;
+        Magazine* cold;
+        Magazine  magazines[2];
+
+        SlabCpuCache() : hot(&magazines[0]), cold(&magazines[1]) {}
+
+        void swap() {
+            Magazine* tmp = hot;
+            hot  = cold;
+            cold = tmp;
+        }
+
+        uint32_t cached() const {
+            return magazines[0].count + magazines[1].count;
+        }
+    };
+
+    /*
+        Cache of fixed-size objects carved out of page-backed slabs in
+        slab-space. The optional ctor runs once when a slab is populated and
+        the dtor once when it is released, so objects handed out by alloc()
+        keep whatever state free() returned them in.
+
+        Objects may be at most MAX_SLAB_PAGES pages and aligned to at most a
+        page. Slab descriptors live in a table indexed by page, so slabs carry
+        no header and free() finds an object's slab without searching.
+
+        Caches only use constexpr construction and have no destructor, so they
+        can live at namespace scope and be used before global constructors run.
+    */
+    class SlabCache : public NonTransferable {
+        public:
+            using Hook = void (*)(void* object);
+
+            static constexpr uint32_t MAX_SLAB_PAGES   = 8;
+            static constexpr uint32_t MIN_SLAB_OBJECTS = 8;
+            static constexpr uint32_t MAX_EMPTY_SLABS  = 1;
+
+            constexpr SlabCache(const char* name, uint32_t size, uint32_t align = 8,
+                                Hook ctor = nullptr, Hook dtor = nullptr)
+                : name_(name), size_(size), align_(align < 4 ? 4 : align),
+                  link_off_(ctor ? align_to(size, 4) : 0),
+                  slot_(align_to(ctor ? align_to(size, 4) + 4 : (size < 4 ? 4 : size), align_)),
+                  slab_pages_(pages_for(slot_)),
+                  slab_objects_((slab_pages_ * PAGE_SIZE) / slot_),
+                  batch_(slab_objects_ < SlabCpuCache::MAGAZINE_SIZE ? slab_objects_ : SlabCpuCache::MAGAZINE_SIZE),
+                  ctor_(ctor), dtor_(dtor), partial_(nullptr),
+                  slab_count_(0), empty_slabs_(0), inuse_(0),
+                  lock_(), cpu_caches_{} {}
+
+            void*       alloc();
+            void        free(void* object);
+
+            // Returns this core's cached objects and every empty slab.
+            void        shrink();
+
+            const char* name() const {
+                return name_;
+            }
+
+            uint32_t    object_size() const {
+                return size_;
+            }
+
+            uint32_t    objects_per_slab() const {
+                return slab_objects_;
+            }
+
+            uint32_t    slab_count() const {
+                return slab_count_;
+            }
+
+            uint32_t    active_objects();
+
+            static bool owns(const void* object);
+
+        private:
+            static constexpr uint32_t align_to(uint32_t val, uint32_t align) {
+                return (val + align - 1) & ~(align - 1);
+            }
+
+            static constexpr uint32_t pages_for(uint32_t slot) {
+                uint32_t pages = 1;
+                while (pages < MAX_SLAB_PAGES && (pages * PAGE_SIZE) / slot < MIN_SLAB_OBJECTS)
+                    pages <<= 1;
+
+                return pages;
+            }
+
+            const char*       name_;
+            const uint32_t    size_;
+            const uint32_t    align_;
+            const uint32_t    link_off_;
+            const uint32_t    slot_;
+            const uint32_t    slab_pages_;
+            const uint32_t    slab_objects_;
+            const uint32_t    batch_;
+            const Hook        ctor_;
+            const Hook        dtor_;
+
+            Slab*             partial_;
+            uint32_t          slab_count_;
+            uint32_t          empty_slabs_;
+            uint32_t          inuse_;
+            kstd::SpinLock    lock_;
+            SlabCpuCache*     cpu_caches_[smp::CoreManager::MAX_CORES];
+
+            SlabCpuCache*     local_cache();
+            uint32_t          refill(void** objects, uint32_t want);
+            Slab*             flush(void** objects, uint32_t count);
+
+            void*             take_locked();
+            Slab*             put_locked(void* object);
+            void              adopt_locked(Slab* slab);
+            void              link_partial(Slab* slab);
+            void              unlink_partial(Slab* slab);
+
+            Slab*             grow();
+            void              release(Slab* slabs);
+
+            void*&            next_free(void* object) const {
+                return *reinterpret_cast<void**>(reinterpret_cast<uint8_t*>(object) + link_off_);
+            }
+    };
+}
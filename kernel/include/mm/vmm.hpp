@@ -6,14 +6,24 @@
 #include <klibcpp/cstdint.hpp>
 #include <klibcpp/cstring.hpp>
 #include <int/idt.hpp>
+#include <io/msr.hpp>
 #include <mm/layout.hpp>
 #include <mm/pmm.hpp>
 
+namespace smp {
+    struct Core;
+}
+
 namespace mm {
     static constexpr uint32_t PDE_BASE  = layout::virt::RECURSIVE_PD_BASE;
     static constexpr uint32_t PT_BASE   = layout::virt::RECURSIVE_PT_BASE;
     static constexpr uint32_t PAGE_MASK = 0xFFFFF000;
 
+    // A PSE directory entry maps one 4 MiB page in place of a page table.
+    static constexpr uint32_t LARGE_PAGE_SIZE   = 0x00400000;
+    static constexpr uint32_t LARGE_PAGE_MASK   = ~(LARGE_PAGE_SIZE - 1);
+    static constexpr uint32_t LARGE_PAGE_FRAMES = LARGE_PAGE_SIZE / PAGE_SIZE;
+
     enum Flags : uint32_t {
         All           = 0,
         Present       = 1 << 0,
@@ -24,6 +34,20 @@ namespace mm {
         Accessed      = 1 << 5,
         Dirty         = 1 << 6,
         HugePage      = 1 << 7,
+        Global        = 1 << 8,
+    };
+
+    /*
+        Caching behaviour of a mapping, selected through the PAT. The first
+        four PAT entries keep their power-on values, so bare PWT/PCD bits mean
+        what they always did; entry 4 is reprogrammed to write-combining.
+    */
+    enum class MemoryType : uint8_t {
+        WriteBack,
+        WriteThrough,
+        UncachedMinus,
+        Uncached,
+        WriteCombining,
     };
 
     struct Entry {
@@ -88,32 +112,157 @@ namespace mm {
         return PT_BASE + (pde_index(virt_addr) << 12);
     }
 
+    /*
+        Remote TLB invalidations collected across map/unmap calls and sent
+        with a single IPI by vmm::commit(). Only pages whose previous entry was
+        present are queued, so filling fresh mappings costs no IPI at all.
+        Receivers invlpg the queued pages, or reload CR3 once more than
+        FLUSH_PAGES were queued. Frames unmapped through a batch go back to the
+        PMM only after the shootdown, so no core can reach a reused frame
+        through a stale entry; they are kept as runs so a 4 MiB page is one
+        record. `global` records that a queued entry carried the Global bit,
+        which a CR3 reload cannot drop.
+    */
+    struct TlbBatch {
+        static constexpr uint32_t FLUSH_PAGES = 16;
+        static constexpr uint32_t MAX_FRAMES  = 32;
+
+        struct FrameRun {
+            uint32_t base;
+            uint32_t count;
+        };
+
+        uint32_t count       = 0;
+        uint32_t pages[FLUSH_PAGES] = {};
+        uint32_t frame_count = 0;
+        FrameRun frames[MAX_FRAMES] = {};
+        bool     global      = false;
+
+        void queue(uint32_t virt_addr, bool global_entry = false) {
+            if (count < FLUSH_PAGES)
+                pages[count] = virt_addr;
+
+            ++count;
+            global |= global_entry;
+        }
+
+        // Returns false when the run cannot be recorded without a commit.
+        bool defer_free(uint32_t base, uint32_t frames_count) {
+            if (frame_count) {
+                FrameRun& last = frames[frame_count - 1];
+                if (last.base + last.count * PAGE_SIZE == base) {
+                    last.count += frames_count;
+                    return true;
+                }
+            }
+
+            if (frame_count == MAX_FRAMES)
+                return false;
+
+            frames[frame_count++] = {base, frames_count};
+            return true;
+        }
+
+        bool full_flush() const {
+            return count > FLUSH_PAGES;
+        }
+
+        bool empty() const {
+            return count == 0 && frame_count == 0;
+        }
+
+        void reset() {
+            count       = 0;
+            frame_count = 0;
+            global      = false;
+        }
+    };
+
+    /*
+        Whether a core may hold live translations. A core parked in hlt is
+        Lazy: shootdowns skip its IPI and mark it LazyFlush instead, and it
+        flushes its whole TLB on its next interrupt before touching kernel
+        memory.
+    */
+    enum class TlbState : uint8_t {
+        Active,
+        Lazy,
+        LazyFlush,
+    };
+
     class vmm {
         public:
             static constexpr uint8_t TLB_SHOOTDOWN_VECTOR = 49;
             static uint32_t kernel_dir_phys;
+            // Set once CR4.PGE is on; every mapping then carries the Global bit.
+            static bool     global_pages;
+            // Set once CR4.PSE is on; aligned 4 MiB spans then use large pages.
+            static bool     large_pages;
+            // Set once IA32_PAT holds PAT_VALUE; without it WriteCombining degrades to UncachedMinus.
+            static bool     pat_enabled;
+
+            static constexpr uint32_t IA32_PAT  = 0x277;
+            /*
+                PA0..PA7 = WB, WT, UC-, UC, WB, WT, UC-, WC. Read through the
+                recursive slot, a 4 MiB PDE is a PTE whose PS bit lands on PAT,
+                so its first frame takes PA4..PA7 by its PWT/PCD bits. PA4..PA6
+                therefore keep their power-on types. WC takes PA7, which only a
+                PCD|PWT large page could select, and large UC pages are mapped
+                UC- instead.
+            */
+            static constexpr uint64_t PAT_VALUE = 0x0107040600070406ULL;
 
             static void init() {
-                uint32_t pd_phys = pmm::alloc_frame();
-                uint32_t pt_phys = pmm::alloc_frame();
+                const uint32_t features = cpu_features();
+                global_pages = features & CPUID_PGE;
+                large_pages  = features & CPUID_PSE;
+                pat_enabled  = features & CPUID_PAT;
 
-                if (!pd_phys || !pt_phys)
+                uint32_t       pd_phys      = pmm::alloc_frame();
+                uint32_t       scratch_phys = pmm::alloc_frame();
+
+                if (!pd_phys || !scratch_phys)
                     kstd::panic("vmm::init: out of physical memory");
 
                 // Assumes low physical memory is identity-mapped at bootstrap.
                 Entry* pd = reinterpret_cast<Entry*>(pd_phys);
-                Entry* pt = reinterpret_cast<Entry*>(pt_phys);
 
                 memset(reinterpret_cast<uint8_t*>(pd), 0, PAGE_SIZE);
-                memset(reinterpret_cast<uint8_t*>(pt), 0, PAGE_SIZE);
-
-                for (uint32_t i = 0; i < (layout::virt::IDENTITY_WINDOW_SIZE / PAGE_SIZE); ++i) {
-                    pt[i].set_address(i * PAGE_SIZE);
-                    pt[i].update_flags(Present | Writable);
+                memset(reinterpret_cast<uint8_t*>(scratch_phys), 0, PAGE_SIZE);
+
+                static_assert(layout::virt::IDENTITY_WINDOW_SIZE == LARGE_PAGE_SIZE);
+
+                const uint32_t identity_flags = Present | Writable | (global_pages ? Global : All);
+                if (large_pages) {
+                    pd[0].set_address(layout::virt::IDENTITY_WINDOW_BASE);
+                    pd[0].update_flags(identity_flags | HugePage);
+                } else {
+                    uint32_t pt_phys = pmm::alloc_frame();
+                    if (!pt_phys)
+                        kstd::panic("vmm::init: out of physical memory");
+
+                    Entry* pt = reinterpret_cast<Entry*>(pt_phys);
+                    memset(reinterpret_cast<uint8_t*>(pt), 0, PAGE_SIZE);
+
+                    for (uint32_t i = 0; i < (layout::virt::IDENTITY_WINDOW_SIZE / PAGE_SIZE); ++i) {
+                        pt[i].set_address(layout::virt::IDENTITY_WINDOW_BASE + i * PAGE_SIZE);
+                        pt[i].update_flags(identity_flags);
+                    }
+
+                    // Framebuffer stores may combine. With PSE the window stays one
+                    // 4 MiB page instead; splitting it for this is not worth the TLB.
+                    for (uint32_t addr = layout::boot::VGA_TEXT_BASE;
+                         addr < layout::boot::VGA_TEXT_BASE + layout::boot::VGA_TEXT_SIZE; addr += PAGE_SIZE)
+                        pt[(addr - layout::virt::IDENTITY_WINDOW_BASE) / PAGE_SIZE].update_flags(cache_bits(MemoryType::WriteCombining));
+
+                    pd[0].set_address(pt_phys);
+                    pd[0].update_flags(Present | Writable);
                 }
 
-                pd[0].set_address(pt_phys);
-                pd[0].update_flags(Present | Writable);
+                // The scratch page table exists up front so kmap_local() never
+                // has to allocate or take the VMM lock.
+                pd[pde_index(layout::virt::SCRATCH_BASE)].set_address(scratch_phys);
+                pd[pde_index(layout::virt::SCRATCH_BASE)].update_flags(Present | Writable);
 
                 pd[1023].set_address(pd_phys);
                 pd[1023].update_flags(Present | Writable);
@@ -122,68 +271,175 @@ namespace mm {
                 idt::register_isr(TLB_SHOOTDOWN_VECTOR, tlb_shootdown_handler);
 
                 kernel_dir_phys = pd_phys;
+                load_pat();
+                enable_paging_features();
                 load_directory(kernel_dir_phys);
                 enable_paging();
             }
 
-            static void map_page(uint32_t virt_addr, uint32_t phys_addr, uint32_t flags) {
-                kstd::SpinLockGuard guard(lock_);
-                map_page_locked(virt_addr, phys_addr, flags);
-                flush_remote_tlbs();
+            /*
+                Every map/unmap call comes in two forms: the plain one shoots
+                down remote TLBs before returning, the one taking a TlbBatch
+                only queues the pages until commit(batch). The plain forms
+                queue into batch_ and commit it before dropping lock_, so they
+                put no TlbBatch on the caller's stack.
+            */
+            static void map_page(uint32_t virt_addr, uint32_t phys_addr, uint32_t flags,
+                                 MemoryType type = MemoryType::WriteBack) {
+                LockGuard guard;
+                map_page_locked(virt_addr, phys_addr, flags, batch_, type);
+                commit_locked(batch_);
             }
 
-            static void map_pages(uint32_t virt_addr, uint32_t phys_addr, uint32_t pages, uint32_t flags) {
-                kstd::SpinLockGuard guard(lock_);
+            static void map_page(uint32_t virt_addr, uint32_t phys_addr, uint32_t flags, TlbBatch& batch,
+                                 MemoryType type = MemoryType::WriteBack) {
+                LockGuard guard;
+                map_page_locked(virt_addr, phys_addr, flags, batch, type);
+            }
 
-                virt_addr = align_address(virt_addr).aligned;
-                phys_addr = align_address(phys_addr).aligned;
+            static void map_pages(uint32_t virt_addr, uint32_t phys_addr, uint32_t pages, uint32_t flags,
+                                  MemoryType type = MemoryType::WriteBack) {
+                LockGuard guard;
+                map_pages_locked(virt_addr, phys_addr, pages, flags, batch_, type);
+                commit_locked(batch_);
+            }
 
-                for (uint32_t i = 0; i < pages; ++i)
-                    map_page_locked(virt_addr + i * PAGE_SIZE, phys_addr + i * PAGE_SIZE, flags);
+            static void map_pages(uint32_t virt_addr, uint32_t phys_addr, uint32_t pages, uint32_t flags,
+                                  TlbBatch& batch, MemoryType type = MemoryType::WriteBack) {
+                LockGuard guard;
+                map_pages_locked(virt_addr, phys_addr, pages, flags, batch, type);
+            }
+
+            // Both addresses must be 4 MiB aligned and the CPU must support PSE.
+            static void map_large_page(uint32_t virt_addr, uint32_t phys_addr, uint32_t flags,
+                                       MemoryType type = MemoryType::WriteBack) {
+                check_large_page(virt_addr, phys_addr);
+
+                LockGuard guard;
+                map_large_page_locked(virt_addr, phys_addr, flags, batch_, type);
+                commit_locked(batch_);
+            }
+
+            static void map_large_page(uint32_t virt_addr, uint32_t phys_addr, uint32_t flags, TlbBatch& batch,
+                                       MemoryType type = MemoryType::WriteBack) {
+                check_large_page(virt_addr, phys_addr);
+
+                LockGuard guard;
+                map_large_page_locked(virt_addr, phys_addr, flags, batch, type);
+            }
 
-                flush_remote_tlbs();
+            // Maps `pages` frames, which need not be contiguous, at consecutive
+            // virtual pages starting at `virt_addr`.
+            static void map_frames(uint32_t virt_addr, const uint32_t* frames, uint32_t pages, uint32_t flags,
+                                   MemoryType type = MemoryType::WriteBack) {
+                LockGuard guard;
+                map_frames_locked(virt_addr, frames, pages, flags, batch_, type);
+                commit_locked(batch_);
             }
 
-            static void map_identity_page(uint32_t addr, uint32_t flags) {
-                map_page(addr, addr, flags);
+            static void map_frames(uint32_t virt_addr, const uint32_t* frames, uint32_t pages, uint32_t flags,
+                                   TlbBatch& batch, MemoryType type = MemoryType::WriteBack) {
+                LockGuard guard;
+                map_frames_locked(virt_addr, frames, pages, flags, batch, type);
             }
 
-            static void map_identity_pages(uint32_t addr, uint32_t pages, uint32_t flags) {
-                map_pages(addr, addr, pages, flags);
+            /*
+                Backs `pages` virtual pages at `virt_addr` with freshly allocated
+                frames, taken in whatever runs the PMM has free rather than one
+                contiguous block. Aligned 4 MiB runs still become large pages.
+                Returns false, with nothing left mapped, when memory runs out.
+            */
+            static bool map_alloc(uint32_t virt_addr, uint32_t pages, uint32_t flags,
+                                  MemoryType type = MemoryType::WriteBack);
+
+            static constexpr uint32_t MAX_LAZY_REGIONS = 8;
+
+            using LazyFilter = bool (*)(void* ctx, uint32_t virt_addr);
+
+            /*
+                Reserves [virt_addr, virt_addr + size) without backing it. The
+                first touch of a page faults, and the handler maps a zeroed frame
+                there with `flags` if `filter` (when given) accepts the address.
+                The fault runs on the faulting stack, so stacks and memory the
+                VMM or PMM use themselves must never be lazily backed.
+            */
+            static bool reserve_lazy(uint32_t virt_addr, uint32_t size, uint32_t flags,
+                                     LazyFilter filter = nullptr, void* ctx = nullptr);
+            // Pages backed so far stay mapped; the owner unmaps them.
+            static void release_lazy(uint32_t virt_addr);
+
+            static void map_identity_page(uint32_t addr, uint32_t flags, MemoryType type = MemoryType::WriteBack) {
+                map_page(addr, addr, flags, type);
             }
 
-            static void map_identity_span(uint32_t addr, uint32_t size, uint32_t flags) {
+            static void map_identity_pages(uint32_t addr, uint32_t pages, uint32_t flags,
+                                           MemoryType type = MemoryType::WriteBack) {
+                map_pages(addr, addr, pages, flags, type);
+            }
+
+            static void map_identity_span(uint32_t addr, uint32_t size, uint32_t flags,
+                                          MemoryType type = MemoryType::WriteBack) {
                 if (!size)
                     return;
 
                 const AlignedResult aligned = align_address(addr);
                 const uint32_t      span    = align_up(aligned.offset + size, PAGE_SIZE);
 
-                map_identity_pages(aligned.aligned, span / PAGE_SIZE, flags);
+                map_identity_pages(aligned.aligned, span / PAGE_SIZE, flags, type);
             }
 
             static void unmap_page(uint32_t virt_addr) {
-                kstd::SpinLockGuard guard(lock_);
-                unmap_page_locked(virt_addr);
-                flush_remote_tlbs();
+                LockGuard guard;
+                unmap_page_locked(virt_addr, batch_);
+                commit_locked(batch_);
+            }
+
+            static void unmap_page(uint32_t virt_addr, TlbBatch& batch) {
+                LockGuard guard;
+                unmap_page_locked(virt_addr, batch);
             }
 
+            // A large page only partly covered by the range is split first.
             static void unmap_pages(uint32_t virt_addr, uint32_t pages) {
-                kstd::SpinLockGuard guard(lock_);
-                virt_addr = align_address(virt_addr).aligned;
+                LockGuard guard;
+                unmap_pages_locked(virt_addr, pages, batch_);
+                commit_locked(batch_);
+            }
 
-                for (uint32_t i = 0; i < pages; ++i)
-                    unmap_page_locked(virt_addr + i * PAGE_SIZE);
+            static void unmap_pages(uint32_t virt_addr, uint32_t pages, TlbBatch& batch) {
+                LockGuard guard;
+                unmap_pages_locked(virt_addr, pages, batch);
+            }
+
+            static void unmap_large_page(uint32_t virt_addr) {
+                LockGuard guard;
+                unmap_large_page_locked(virt_addr & LARGE_PAGE_MASK, batch_);
+                commit_locked(batch_);
+            }
 
-                flush_remote_tlbs();
+            static void unmap_large_page(uint32_t virt_addr, TlbBatch& batch) {
+                LockGuard guard;
+                unmap_large_page_locked(virt_addr & LARGE_PAGE_MASK, batch);
+            }
+
+            // Shoots down every page queued in `batch`, then frees its frames.
+            static void commit(TlbBatch& batch) {
+                if (batch.empty())
+                    return;
+
+                LockGuard guard;
+                commit_locked(batch);
             }
 
             static uint32_t virt_to_phys(uint32_t virt_addr) {
-                kstd::SpinLockGuard guard(lock_);
-                Entry&              pde = pde_entry(virt_addr);
+                LockGuard guard;
+                Entry&    pde = pde_entry(virt_addr);
                 if (!pde.has_flag(Present))
                     return 0xFFFFFFFF;
 
+                if (pde.has_flag(HugePage))
+                    return (pde.value & LARGE_PAGE_MASK) | (virt_addr & ~LARGE_PAGE_MASK);
+
                 Entry& pte = pte_entry(virt_addr);
                 if (!pte.has_flag(Present))
                     return 0xFFFFFFFF;
@@ -192,14 +448,34 @@ namespace mm {
             }
 
             static bool is_mapped(uint32_t virt_addr) {
-                kstd::SpinLockGuard guard(lock_);
-                Entry&              pde = pde_entry(virt_addr);
+                LockGuard guard;
+                Entry&    pde = pde_entry(virt_addr);
                 if (!pde.has_flag(Present))
                     return false;
 
+                if (pde.has_flag(HugePage))
+                    return true;
+
                 return pte_entry(virt_addr).has_flag(Present);
             }
 
+            static constexpr uint32_t KMAP_SLOTS = layout::virt::SCRATCH_SLOTS_PER_CORE;
+
+            /*
+                Maps the frame holding `phys_addr` into the current core's next
+                free scratch slot and returns the matching virtual address. Slots
+                are only ever touched by their own core, so mapping and unmapping
+                cost one local invlpg and never a shootdown. Callers must keep
+                interrupts disabled until kunmap_local(), and unmap in reverse
+                order; each core can hold KMAP_SLOTS mappings at once.
+            */
+            static uint32_t kmap_local(uint32_t phys_addr);
+            static void     kunmap_local(uint32_t virt_addr);
+
+            // Maps a physically contiguous span through consecutive slots.
+            static uint32_t kmap_local_span(uint32_t phys_addr, uint32_t size);
+            static void     kunmap_local_span(uint32_t virt_addr, uint32_t size);
+
             static inline void load_directory(uint32_t phys_addr) {
                 __asm__ volatile ("mov %0, %%cr3" : : "r"(phys_addr) : "memory");
             }
@@ -215,14 +491,83 @@ namespace mm {
                 __asm__ volatile ("mov %0, %%cr0" : : "r"(cr0));
             }
 
+            // CR4 bits the kernel directory relies on; APs load them in the trampoline.
+            static inline uint32_t paging_features() {
+                return (large_pages ? CR4_PSE : 0) | (global_pages ? CR4_PGE : 0);
+            }
+
+            static inline void enable_paging_features() {
+                uint32_t cr4;
+                __asm__ volatile ("mov %%cr4, %0" : "=r"(cr4));
+                cr4 |= paging_features();
+                __asm__ volatile ("mov %0, %%cr4" : : "r"(cr4) : "memory");
+            }
+
+            // Every core has to load the same PAT before using WriteCombining mappings.
+            static inline void load_pat() {
+                if (pat_enabled)
+                    write_msr(IA32_PAT, PAT_VALUE);
+            }
+
+            // PWT/PCD/PAT bits selecting `type`; the PAT bit sits higher in a 4 MiB PDE.
+            static uint32_t cache_bits(MemoryType type, bool large = false) {
+                switch (type) {
+                    case MemoryType::WriteThrough:
+                        return WriteThrough;
+                    case MemoryType::UncachedMinus:
+                        return CacheDisabled;
+                    case MemoryType::Uncached:
+                        if (large && pat_enabled)
+                            return CacheDisabled;
+
+                        return CacheDisabled | WriteThrough;
+                    case MemoryType::WriteCombining:
+                        if (!pat_enabled)
+                            return CacheDisabled;
+
+                        return (large ? LARGE_PAT : PAT) | CacheDisabled | WriteThrough;
+                    default:
+                        return 0;
+                }
+            }
+
+            // Drops every non-global translation.
             static inline void flush_current_tlb() {
                 load_directory(kernel_dir_phys);
             }
 
+            // Drops global translations too, by toggling CR4.PGE.
+            static inline void flush_global_tlb() {
+                if (!global_pages) {
+                    flush_current_tlb();
+                    return;
+                }
+
+                uint32_t cr4;
+                __asm__ volatile ("mov %%cr4, %0" : "=r"(cr4));
+                __asm__ volatile ("mov %0, %%cr4" : : "r"(cr4 & ~CR4_PGE) : "memory");
+                __asm__ volatile ("mov %0, %%cr4" : : "r"(cr4) : "memory");
+            }
+
+            // Called with interrupts disabled right before a core halts.
+            static void enter_lazy_tlb(smp::Core& core);
+            // Called on interrupt entry; flushes if a shootdown was deferred.
+            static void leave_lazy_tlb(smp::Core& core);
+
+            /*
+                Runs this core's part of the shootdown in progress, if it still
+                owes one. Anything spinning with interrupts off on a lock whose
+                holder may unmap pages calls this, or the holder waits forever.
+            */
+            static void answer_shootdown();
+
             static void page_fault(uint32_t err_code, idt::BaseInterruptFrame* ctx) {
                 uint32_t cr2;
                 __asm__ volatile ("mov %%cr2, %0" : "=r"(cr2));
 
+                if (!(err_code & 0x1) && resolve_lazy_fault(cr2))
+                    return;
+
                 const char* err = "Unknown";
 
                 if (!(err_code & 0x1)) {
@@ -240,59 +585,195 @@ namespace mm {
             }
 
         private:
+            static constexpr uint32_t CR4_PSE   = 1 << 4;
+            static constexpr uint32_t CR4_PGE   = 1 << 7;
+            static constexpr uint32_t CPUID_PSE = 1 << 3;
+            static constexpr uint32_t CPUID_PGE = 1 << 13;
+            static constexpr uint32_t CPUID_PAT = 1 << 16;
+
+            // PAT index bit 2: bit 7 of a PTE, bit 12 of a 4 MiB PDE.
+            static constexpr uint32_t PAT       = 1 << 7;
+            static constexpr uint32_t LARGE_PAT = 1 << 12;
+
             inline static kstd::SpinLock lock_;
+            // Only used under lock_ and always committed before it is dropped.
+            inline static TlbBatch       batch_;
+
+            // CPUID leaf 1 EDX.
+            static uint32_t cpu_features() {
+                uint32_t eax = 1, ebx, ecx = 0, edx;
+                __asm__ volatile ("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+                return edx;
+            }
+
+            static void flush_remote_tlbs(const TlbBatch& batch);
+            static bool resolve_lazy_fault(uint32_t virt_addr);
+
+            /*
+                Every acquisition of lock_. Its holder may be in flush_remote_tlbs()
+                waiting on this core, which cannot take the IPI while it spins with
+                interrupts off (in the page fault handler, or under an
+                InterruptSpinLockGuard), so the spin answers the shootdown itself.
+            */
+            class LockGuard : public NonTransferable {
+                public:
+                    LockGuard() {
+                        while (!lock_.try_lock()) {
+                            answer_shootdown();
+                            __pause;
+                        }
+                    }
+
+                    ~LockGuard() {
+                        lock_.unlock();
+                    }
+            };
+
+            static void commit_locked(TlbBatch& batch) {
+                flush_remote_tlbs(batch);
+
+                for (uint32_t i = 0; i < batch.frame_count; ++i) {
+                    const TlbBatch::FrameRun& run = batch.frames[i];
+
+                    if (run.count == 1)
+                        pmm::free_frame(run.base);
+                    else
+                        pmm::free_frames(run.base, run.count);
+                }
+
+                batch.reset();
+            }
 
-            static void flush_remote_tlbs();
             static void tlb_shootdown_handler(uint32_t err_code, idt::BaseInterruptFrame* ctx);
 
-            static void ensure_page_table(uint32_t virt_addr, uint32_t flags) {
+            static void defer_free_locked(uint32_t base, uint32_t frames, TlbBatch& batch) {
+                // Out of room for deferred frames: shoot down what is queued so far.
+                if (!batch.defer_free(base, frames)) {
+                    commit_locked(batch);
+                    batch.defer_free(base, frames);
+                }
+            }
+
+            static void check_large_page(uint32_t virt_addr, uint32_t phys_addr) {
+                if (!large_pages || (virt_addr & ~LARGE_PAGE_MASK) || (phys_addr & ~LARGE_PAGE_MASK))
+                    kstd::panic("map_large_page: cannot map 0x%08x -> 0x%08x\n", virt_addr, phys_addr);
+            }
+
+            static void split_large_page_locked(uint32_t virt_addr, TlbBatch& batch);
+            static void map_large_page_locked(uint32_t virt_addr, uint32_t phys_addr, uint32_t flags, TlbBatch& batch,
+                                              MemoryType type);
+            static void unmap_large_page_locked(uint32_t virt_addr, TlbBatch& batch);
+
+            static void ensure_page_table(uint32_t virt_addr, uint32_t flags, TlbBatch& batch) {
                 Entry& pde = pde_entry(virt_addr);
+                if (pde.has_flag(Present | HugePage))
+                    split_large_page_locked(virt_addr, batch);
+
                 if (pde.has_flag(Present)) {
-                    pde.update_flags(flags);
+                    // Bit 8 of a PDE would make the recursive view of this page table
+                    // global. Large PDEs do keep Global, so unmapping or splitting one
+                    // queues its recursive view with that bit.
+                    pde.update_flags(flags & ~Global);
                     return;
                 }
 
-                const uint32_t pt_phys = pmm::alloc_frame();
+                // Zeroed so untouched PTEs cannot inherit stale state.
+                const uint32_t pt_phys = pmm::alloc_zeroed_frame();
                 if (!pt_phys)
                     kstd::panic("ensure_page_table: out of physical memory");
 
                 pde.invalidate();
                 pde.set_address(pt_phys);
                 pde.update_flags(Present | Writable | (flags & User));
-
-                // New page tables come from PMM as raw frames. Clear the recursive
-                // mapping view so untouched PTEs cannot inherit stale state.
-                memset(reinterpret_cast<uint8_t*>(pt_virtual_base(virt_addr)), 0, PAGE_SIZE);
             }
 
-            static void map_page_locked(uint32_t virt_addr, uint32_t phys_addr, uint32_t flags) {
+            static void map_page_locked(uint32_t virt_addr, uint32_t phys_addr, uint32_t flags, TlbBatch& batch,
+                                        MemoryType type = MemoryType::WriteBack) {
                 virt_addr = align_address(virt_addr).aligned;
                 phys_addr = align_address(phys_addr).aligned;
 
-                ensure_page_table(virt_addr, flags);
+                ensure_page_table(virt_addr, flags, batch);
 
-                Entry& pte = pte_entry(virt_addr);
+                Entry&         pte      = pte_entry(virt_addr);
+                const uint32_t previous = pte.value;
                 pte.invalidate();
                 pte.set_address(phys_addr);
-                pte.update_flags(flags);
+                pte.update_flags((global_pages ? flags | Global : flags) | cache_bits(type));
+
+                // Non-present entries are never cached, so filling one needs no
+                // invalidation anywhere.
+                if (!(previous & Present) || previous == pte.value)
+                    return;
 
                 flush_tlb(virt_addr);
+                batch.queue(virt_addr, previous & Global);
+            }
+
+            static void map_pages_locked(uint32_t virt_addr, uint32_t phys_addr, uint32_t pages, uint32_t flags,
+                                         TlbBatch& batch, MemoryType type) {
+                virt_addr = align_address(virt_addr).aligned;
+                phys_addr = align_address(phys_addr).aligned;
+
+                for (uint32_t i = 0; i < pages;) {
+                    const uint32_t virt = virt_addr + i * PAGE_SIZE;
+                    const uint32_t phys = phys_addr + i * PAGE_SIZE;
+
+                    if (large_pages && pages - i >= LARGE_PAGE_FRAMES &&
+                        !(virt & ~LARGE_PAGE_MASK) && !(phys & ~LARGE_PAGE_MASK)) {
+                        map_large_page_locked(virt, phys, flags, batch, type);
+                        i += LARGE_PAGE_FRAMES;
+                    } else {
+                        map_page_locked(virt, phys, flags, batch, type);
+                        ++i;
+                    }
+                }
+            }
+
+            static void map_frames_locked(uint32_t virt_addr, const uint32_t* frames, uint32_t pages, uint32_t flags,
+                                          TlbBatch& batch, MemoryType type) {
+                virt_addr = align_address(virt_addr).aligned;
+
+                for (uint32_t i = 0; i < pages; ++i)
+                    map_page_locked(virt_addr + i * PAGE_SIZE, frames[i], flags, batch, type);
             }
 
-            static void unmap_page_locked(uint32_t virt_addr) {
+            static void unmap_page_locked(uint32_t virt_addr, TlbBatch& batch) {
                 virt_addr = align_address(virt_addr).aligned;
 
                 Entry& pde = pde_entry(virt_addr);
                 if (!pde.has_flag(Present))
                     return;
 
+                if (pde.has_flag(HugePage))
+                    split_large_page_locked(virt_addr, batch);
+
                 Entry& pte = pte_entry(virt_addr);
                 if (!pte.has_flag(Present))
                     return;
 
-                pmm::free_frame(pte.address());
+                defer_free_locked(pte.address(), 1, batch);
+
+                const bool global = pte.has_flag(Global);
                 pte.invalidate();
                 flush_tlb(virt_addr);
+                batch.queue(virt_addr, global);
+            }
+
+            static void unmap_pages_locked(uint32_t virt_addr, uint32_t pages, TlbBatch& batch) {
+                virt_addr = align_address(virt_addr).aligned;
+
+                for (uint32_t i = 0; i < pages;) {
+                    const uint32_t virt = virt_addr + i * PAGE_SIZE;
+
+                    if (pages - i >= LARGE_PAGE_FRAMES && !(virt & ~LARGE_PAGE_MASK) &&
+                        pde_entry(virt).has_flag(Present | HugePage)) {
+                        unmap_large_page_locked(virt, batch);
+                        i += LARGE_PAGE_FRAMES;
+                    } else {
+                        unmap_page_locked(virt, batch);
+                        ++i;
+                    }
+                }
             }
     };
 }
@@ -0,0 +1,98 @@
+/*
+    This file contains implementation of
+    OS++ kernel virtual range allocator.
+*/
+#pragma once
+
+#include <klibcpp/cstdint.hpp>
+#include <klibcpp/spinlock.hpp>
+#include <klibcpp/trivial.hpp>
+#include <mm/layout.hpp>
+
+namespace mm {
+    struct VRange;
+
+    /*
+        Hands out page ranges from one MapKind::Pool region of kernel virtual
+        space. Free ranges sit in an AVL tree keyed by address and augmented
+        with the largest free run below each node, so first-fit allocation,
+        freeing with coalescing and containment lookups are all O(log n).
+        Live allocations sit in a second tree, which lets free() and lookup()
+        work from an address alone.
+
+        Every allocation is followed by GUARD_PAGES reserved pages that are
+        never handed out, so running off the end of a buffer faults instead of
+        landing in its neighbour. An arena only manages addresses; callers map
+        and unmap the pages themselves (see vmalloc()).
+
+        Arenas only use constexpr construction, tree nodes come from a slab
+        cache, and the region is seeded on first use, so arenas work before
+        global constructors run.
+    */
+    class VirtualArena : public NonTransferable {
+        public:
+            static constexpr uint32_t GUARD_PAGES = 1;
+
+            constexpr explicit VirtualArena(const layout::virt::RegionDesc& region)
+                : region_(region), lock_(), free_(nullptr), used_(nullptr), seeded_(false),
+                  free_pages_(region.size / PAGE_SIZE), allocations_(0) {}
+
+            // Returns the base of `pages` fresh pages, or 0 when the region is exhausted.
+            uint32_t alloc(uint32_t pages);
+            // Releases the allocation starting at `base`; returns its size in pages, 0 if unknown.
+            uint32_t free(uint32_t base);
+            // Finds the live allocation covering `addr`.
+            bool     lookup(uint32_t addr, uint32_t& base, uint32_t& pages);
+
+            bool contains(uint32_t addr) {
+                uint32_t base, pages;
+                return lookup(addr, base, pages);
+            }
+
+            uint32_t free_pages() const {
+                return free_pages_;
+            }
+
+            uint32_t allocations() const {
+                return allocations_;
+            }
+
+            const layout::virt::RegionDesc& region() const {
+                return region_;
+            }
+
+        private:
+            const layout::virt::RegionDesc& region_;
+            kstd::SpinLock                  lock_;
+            VRange*                         free_;
+            VRange*                         used_;
+            bool                            seeded_;
+            uint32_t                        free_pages_;
+            uint32_t                        allocations_;
+    };
+
+    namespace vspace {
+        // Lets vreserve() allocations fault their pages in; call after vmm::init().
+        void init();
+
+        /*
+            The arena for a pool region. The kernel heap and slab space manage
+            their regions themselves and must not be handed out through here.
+        */
+        template<layout::virt::RegionId Id>
+        VirtualArena& arena() {
+            static_assert(layout::virt::region<Id>().kind == layout::virt::MapKind::Pool,
+                "virtual arenas can only be built on pool regions");
+
+            static VirtualArena value(layout::virt::region<Id>());
+            return value;
+        }
+    }
+
+    // Page-granular buffers from vmalloc space, backed by scattered frames.
+    void* vmalloc(uint32_t size);
+    // Like vmalloc(), but each page is only backed when first touched.
+    void* vreserve(uint32_t size);
+    // Releases either kind of buffer.
+    void  vfree(void* ptr);
+}
@@ -2,7 +2,6 @@
 
 #include <klibcpp/atomic.hpp>
 #include <klibcpp/spinlock.hpp>
-#include <klibcpp/static_array.hpp>
 #include <klibcpp/cstdint.hpp>
 #include <klibcpp/trivial.hpp>
 #include <int/idt.hpp>
@@ -17,12 +16,17 @@ namespace sched {
         TERMINATED
     };
 
-    struct Task {
+    // Priority 0 is the idle class; everything else preempts it.
+    static constexpr uint8_t PRIORITY_LEVELS  = 32;
+    static constexpr uint8_t IDLE_PRIORITY    = 0;
+    static constexpr uint8_t DEFAULT_PRIORITY = 16;
+
+    // Allocated once per task and never copied; migration relinks it onto another core's lists.
+    struct Task : public NonTransferable {
         public:
             uint32_t            id;
 
-            idt::InterruptFrame ctx;
-
+            // Address of the frame the task resumes from, saved on its own stack; 0 while it has never been switched out.
             uint32_t            stack_ptr;
             smp::BaseCoreStack* stack;
             bool                own_stack;
@@ -30,9 +34,30 @@ namespace sched {
             TaskState           state;
             const char*         name;
 
-            Task(uint32_t id, const char* name, smp::BaseCoreStack* task_stack);
+            // Higher runs first; idle-class tasks never migrate.
+            uint8_t             priority;
+            // Links on the ready list while READY, on a wait queue or the sleep list while BLOCKED.
+            Task*               ready_prev;
+            Task*               ready_next;
+
+            // Set by prepare_block(); the next switch parks the task as BLOCKED.
+            bool                block_pending;
+            // PIT tick a sleeping task wakes at, 0 when it waits for an explicit wake().
+            uint64_t            wake_tick;
+            // Set when a WaitQueue::hand_off() picked this waiter.
+            bool                handed_off;
+
+            Task(uint32_t id, const char* name, smp::BaseCoreStack* task_stack, smp::Core& core);
             ~Task();
 
+            bool is_idle() const {
+                return priority == IDLE_PRIORITY;
+            }
+
+            idt::InterruptFrame& frame() const {
+                return *reinterpret_cast<idt::InterruptFrame*>(stack_ptr);
+            }
+
             static void _die() {
                 __asm__ volatile (
                      /*
@@ -64,28 +89,120 @@ namespace sched {
             }
     };
 
+    struct BalanceStats {
+        uint32_t idle_steals;      // Tasks this core took because it had nothing else to run.
+        uint32_t rebalance_steals; // Tasks this core took during a periodic rebalance.
+        uint32_t rebalance_passes;
+        uint32_t contended;        // Steals abandoned because the victim's queue was locked.
+        uint32_t stolen;           // Tasks peers took from this core.
+    };
+
+    struct ReadyList {
+        Task* head;
+        Task* tail;
+    };
+
+    /*
+        One scheduler per core. Each core preempts its own run queue from its
+        LAPIC timer. READY tasks sit on one FIFO per priority and a bitmap
+        marks the non-empty ones, so picking the next task is a bsr plus a
+        list pop no matter how many tasks exist; the highest priority always
+        wins and equal priorities share the core round-robin. BLOCKED tasks
+        are on no ready list and cost nothing until woken; sleepers are woken
+        from the timer. spawn() picks a task's first core; after that a core
+        with nothing to run steals a READY task from the busiest peer, and
+        every REBALANCE_TICKS ticks each core also steals when a peer has at
+        least two more runnable tasks than it does.
+
+        A switch saves nothing by copy: the context_switch stub leaves each
+        task's frame on that task's own stack, and schedule() hands the stub
+        the next task's frame to pop instead.
+
+        Thieves only try-lock the victim's queue while already holding their
+        own, so two cores stealing from each other back off instead of
+        deadlocking.
+    */
     class Scheduler : public NonTransferable {
         private:
-            kstd::StaticArray<Task, 256> tasks;
-            uint32_t current_task_index;
-            uint32_t next_task_id;
+            smp::Core&                   core;
+            Task*                        current;
+            Task*                        exiting;    // Terminated task this core is switching off.
+            Task*                        dead;       // Terminated tasks off every stack, freed by reap().
+            ReadyList                    ready[PRIORITY_LEVELS];
+            uint32_t                     ready_mask; // Bit per non-empty ready list.
+            Task*                        sleepers;   // Sorted by wake_tick.
             kstd::Atomic<bool> initialized;
             uint32_t time_slice_ms;
             kstd::SpinLock lock;
 
-            static void timer_tick(idt::InterruptFrame* ctx, void*);
+            // Non-idle tasks that are READY or RUNNING; read by peers without the lock.
+            kstd::Atomic<uint32_t> runnable;
+            uint32_t               ticks_since_rebalance;
+            BalanceStats           balance;
+
+            void   enqueue(Task& task);
+            void   unlink(Task& task);
+            void   make_ready(Task& task);
+            void   park(Task& task);
+            void   wake_sleepers();
+            Task*  pick_next();
+            bool   steal(bool rebalance);
+            void   reap();
+
+            // LAPIC timer ticks per millisecond, measured once against the PIT.
+            inline static uint32_t timer_ticks_per_ms = 0;
+            inline static kstd::Atomic<uint32_t> next_core{0};
+            // Task ids are unique across cores, so they can name a lock owner.
+            inline static kstd::Atomic<uint32_t> next_task_id{1};
 
         public:
-            Scheduler(uint32_t time_slice_ms = 10);
+            static constexpr uint8_t YIELD_VECTOR = 48;
+            static constexpr uint8_t TICK_VECTOR  = 50;
+            static constexpr uint32_t REBALANCE_TICKS = 10;
+
+            // Runs on the core it schedules, which is the core its timer ticks on.
+            explicit Scheduler(smp::Core& core, uint32_t time_slice_ms = 10);
             ~Scheduler();
 
+            // Installs the reschedule vectors and calibrates the LAPIC timer; BSP only, before APs start.
+            static void install();
+
+            /*
+                Creates a task on the least-loaded running core, rotating
+                between equally loaded ones. The returned task stays valid
+                across migrations until it terminates.
+            */
+            static Task& spawn(const char* name, void (*entry_point)(), uint8_t priority = DEFAULT_PRIORITY);
+
             bool is_initialized() const { return initialized.load(kstd::MemoryOrder::Acquire); }
 
-            Task&       create_task(const char* name, void (*entry_point)());
+            Task&       create_task(const char* name, void (*entry_point)(), uint8_t priority = DEFAULT_PRIORITY);
 
             void        schedule(idt::InterruptFrame* ctx);
             void        yield();
+            void        stop();
+
+            /*
+                Marks the running task to block at the next switch and returns
+                it; `wake_tick` != 0 makes the timer wake it. Call with
+                interrupts off and yield() before restoring them.
+            */
+            Task&       prepare_block(uint64_t wake_tick = 0);
+
+            // Readies a task parked with prepare_block(0), or cancels its pending block.
+            static void wake(Task& task);
+
+            // Runnable non-idle tasks.
+            uint32_t    load() const { return runnable.load(kstd::MemoryOrder::Relaxed); }
+
+            void        balance_stats(BalanceStats& out);
 
             Task&       current_task();
     };
+
+    // Whether the caller runs as a task that may block: a started scheduler and not the idle class.
+    bool can_block();
+
+    // Blocks the calling task for at least `us`; busy-waits where there is no task to block.
+    void sleep_for(uint32_t us);
 }
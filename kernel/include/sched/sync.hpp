@@ -0,0 +1,100 @@
+#pragma once
+
+#include <klibcpp/atomic.hpp>
+#include <klibcpp/cstdint.hpp>
+#include <klibcpp/trivial.hpp>
+#include <sched/wait_queue.hpp>
+
+namespace sched {
+    // Acquire attempts a contended primitive spins through before it blocks.
+    static constexpr uint32_t SYNC_SPIN_LIMIT = 128;
+
+    /*
+        Sleeping, non-recursive lock. Contended callers spin briefly and
+        then block on the mutex's wait queue. unlock() hands ownership
+        straight to the longest waiter, so one task wakes per release and
+        a newcomer cannot barge past a queued waiter.
+
+        Holders keep interrupts enabled, so a mutex must never be taken
+        from an interrupt handler. Contexts that cannot block spin instead:
+        early boot, shutdown, and the idle class.
+    */
+    class Mutex : public NonTransferable {
+        public:
+            constexpr Mutex() : owner_(0), waiters_() {}
+
+            void lock();
+            bool try_lock();
+            void unlock();
+
+            bool held() const {
+                return owner_.load(kstd::MemoryOrder::Relaxed) != 0;
+            }
+
+        private:
+            // Owner while a hand_off() is waking the next holder.
+            static constexpr uint32_t HANDOFF_PENDING = 0xFFFFFFFF;
+
+            kstd::Atomic<uint32_t> owner_; // Owner id, 0 when free.
+            WaitQueue              waiters_;
+
+            bool try_acquire(uint32_t owner);
+    };
+
+    class MutexGuard : public NonTransferable {
+        public:
+            explicit MutexGuard(Mutex& mutex)
+                : mutex_(mutex) {
+                mutex_.lock();
+            }
+
+            ~MutexGuard() {
+                mutex_.unlock();
+            }
+
+        private:
+            Mutex& mutex_;
+    };
+
+    // Counting semaphore; release() hands a unit straight to the longest waiter.
+    class Semaphore : public NonTransferable {
+        public:
+            constexpr explicit Semaphore(uint32_t count = 0) : count_(count), waiters_() {}
+
+            void acquire();
+            bool try_acquire();
+            void release();
+
+            uint32_t count() const {
+                return count_.load(kstd::MemoryOrder::Relaxed);
+            }
+
+        private:
+            kstd::Atomic<uint32_t> count_;
+            WaitQueue              waiters_;
+    };
+
+    /*
+        Condition variable for a Mutex. wait() queues the caller before it
+        drops the mutex, so a notify issued once the mutex is free always
+        finds it. Woken tasks retake the mutex through its handoff queue.
+    */
+    class CondVar : public NonTransferable {
+        public:
+            constexpr CondVar() : waiters_() {}
+
+            void wait(Mutex& mutex);
+
+            template<typename Pred>
+            void wait(Mutex& mutex, Pred pred) {
+                while (!pred())
+                    wait(mutex);
+            }
+
+            void notify_one();
+            void notify_all();
+
+        private:
+            WaitQueue waiters_;
+    };
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <klibcpp/cstdint.hpp>
+#include <klibcpp/iguard.hpp>
+#include <klibcpp/spinlock.hpp>
+#include <klibcpp/trivial.hpp>
+#include <sched/scheduler.hpp>
+
+namespace sched {
+    /*
+        FIFO of tasks blocked on an event. Waiters are linked through their
+        own Task, so a queue needs no storage and waiting costs no CPU.
+
+        A waker changes the condition first and then calls wake_*(). Use
+        wait_until() to wait for a condition: it checks the predicate under
+        the queue lock, so a wakeup between the check and the block is not
+        lost. Woken tasks run from their core's next reschedule.
+
+        hand_off() wakes a single waiter and tells it so, which lets a lock
+        pass ownership straight to the longest waiter instead of waking
+        everyone to race for it.
+    */
+    class WaitQueue : public NonTransferable {
+        public:
+            constexpr WaitQueue() : lock_(), head_(nullptr), tail_(nullptr) {}
+
+            // Blocks the calling task until a wake_one()/wake_all() picks it.
+            void     wait();
+
+            template<typename Pred>
+            void wait_until(Pred pred) {
+                while (true) {
+                    kstd::InterruptGuard guard;
+
+                    {
+                        kstd::SpinLockGuard lock(lock_);
+                        if (pred())
+                            return;
+
+                        park_current();
+                    }
+
+                    smp::CoreManager::current_core()->scheduler().yield();
+                }
+            }
+
+            // Like wait_until(), but also returns once hand_off() picks the caller.
+            template<typename Pred>
+            void wait_handoff(Pred pred) {
+                wait_until([&]() {
+                        return take_handoff() || pred();
+                    });
+            }
+
+            /*
+                Parks the calling task, runs `release` and then blocks, so a
+                wake triggered by `release` itself is not lost.
+            */
+            template<typename Release>
+            void wait_releasing(Release release) {
+                kstd::InterruptGuard guard;
+
+                {
+                    kstd::SpinLockGuard lock(lock_);
+                    park_current();
+                }
+
+                release();
+                smp::CoreManager::current_core()->scheduler().yield();
+            }
+
+            /*
+                Wakes the longest waiter with its handoff flag set. Without a
+                waiter `on_empty` runs instead, still under the queue lock, so
+                it can publish state a new waiter's predicate checks. Returns
+                whether a task was handed off to.
+            */
+            template<typename OnEmpty>
+            bool hand_off(OnEmpty on_empty) {
+                Task* task;
+
+                {
+                    kstd::InterruptSpinLockGuard guard(lock_);
+
+                    task = pop_locked();
+                    if (!task) {
+                        on_empty();
+                        return false;
+                    }
+
+                    task->handed_off = true;
+                }
+
+                Scheduler::wake(*task);
+                return true;
+            }
+
+            // Returns whether a task was woken.
+            bool     wake_one();
+            // Returns the number of tasks woken.
+            uint32_t wake_all();
+
+            bool empty() const {
+                return head_ == nullptr;
+            }
+
+        private:
+            kstd::SpinLock lock_;
+            Task*          head_;
+            Task*          tail_;
+
+            // Appends the running task; called with interrupts off and `lock_` held.
+            void  park_current();
+            Task* pop_locked();
+            // Consumes the running task's handoff flag; called with interrupts off and `lock_` held.
+            static bool take_handoff();
+    };
+}
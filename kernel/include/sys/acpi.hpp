@@ -2,6 +2,7 @@
 
 #include <klibcpp/cstdint.hpp>
 #include <klibcpp/cstring.hpp>
+#include <klibcpp/iguard.hpp>
 #include <mm/layout.hpp>
 #include <mm/vmm.hpp>
 #include <log.hpp>
@@ -71,16 +72,14 @@ class acpi {
             }
 
             LOG_INFO("[acpi] RSDT found at 0x%08x\n", (uint32_t)rsdt);
-            // Map only SDT header for read it
-            mm::vmm::map_identity_page((uint32_t)rsdt, mm::Flags::Present | mm::Flags::Writable);
-            if (!validate_checksum(rsdt)) {
+            const uint32_t length = checked_table_length((uint32_t)rsdt);
+            if (!length) {
                 LOG_WARN("[acpi] RSDT checksum invalid\n");
-                mm::vmm::unmap_page((uint32_t)rsdt);
                 return;
             }
 
-            // Map rest of SDT data
-            mm::vmm::map_identity_span((uint32_t)rsdt, rsdt->length, mm::Flags::Present | mm::Flags::Writable);
+            // Only a valid table is mapped for good.
+            mm::vmm::map_identity_span((uint32_t)rsdt, length, mm::Flags::Present | mm::Flags::Writable);
         }
 
         template<typename T>
@@ -138,6 +137,28 @@ class acpi {
             return validate_checksum(hdr, hdr->length);
         }
 
+        /*
+            Reads and checksums the table at `phys` through kmap slots, so
+            rejecting it leaves no mapping to tear down. Returns its length,
+            or 0 if it is invalid or too large to inspect this way.
+        */
+        static uint32_t checked_table_length(uint32_t phys) {
+            kstd::InterruptGuard guard;
+
+            auto*          header = reinterpret_cast<SDTHeader*>(mm::vmm::kmap_local_span(phys, sizeof(SDTHeader)));
+            const uint32_t length = header->length;
+            mm::vmm::kunmap_local_span(reinterpret_cast<uint32_t>(header), sizeof(SDTHeader));
+
+            if (length < sizeof(SDTHeader) || length > (mm::vmm::KMAP_SLOTS - 1) * mm::PAGE_SIZE)
+                return 0;
+
+            void*          table = reinterpret_cast<void*>(mm::vmm::kmap_local_span(phys, length));
+            const bool     valid = validate_checksum(table, length);
+            mm::vmm::kunmap_local_span(reinterpret_cast<uint32_t>(table), length);
+
+            return valid ? length : 0;
+        }
+
         static bool validate_checksum(void* data, size_t length) {
             uint8_t sum = 0;
             for (size_t i = 0; i < length; ++i)
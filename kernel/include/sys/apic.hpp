@@ -153,6 +153,33 @@ struct LAPIC {
     uint8_t id() {
         return (get_reg(LAPICRegister::ID) >> 24) & 0xFF;
     }
+
+    static constexpr uint32_t TIMER_MASKED    = 1 << 16;
+    static constexpr uint32_t TIMER_PERIODIC  = 1 << 17;
+    static constexpr uint32_t TIMER_DIVIDE_16 = 0x3;
+
+    // Fires `vector` on this core every `count` timer ticks (bus clock / 16).
+    void start_timer(uint8_t vector, uint32_t count) {
+        get_reg(LAPICRegister::DCR)    = TIMER_DIVIDE_16;
+        get_reg(LAPICRegister::LVT_TR) = vector | TIMER_PERIODIC;
+        get_reg(LAPICRegister::ICR)    = count;
+    }
+
+    // Starts a masked one-shot countdown from `count`, read back with timer_count().
+    void start_timer_probe(uint32_t count) {
+        get_reg(LAPICRegister::DCR)    = TIMER_DIVIDE_16;
+        get_reg(LAPICRegister::LVT_TR) = TIMER_MASKED;
+        get_reg(LAPICRegister::ICR)    = count;
+    }
+
+    uint32_t timer_count() {
+        return get_reg(LAPICRegister::CCR);
+    }
+
+    void stop_timer() {
+        get_reg(LAPICRegister::LVT_TR) = TIMER_MASKED;
+        get_reg(LAPICRegister::ICR)    = (uint32_t)0;
+    }
 };
 
 struct IOAPIC {
@@ -298,15 +325,21 @@ class apic : public NonTransferable {
         }
 
         void init() {
-            auto madt = acpi::find_sdth<MADT>("APIC");
-            if (!madt) {
+            auto table = acpi::find_sdth<MADT>("APIC");
+            if (!table) {
                 LOG_WARN("[apic] MADT not found\n");
                 return;
             }
 
+            LOG_INFO("[apic] MADT found at 0x%08x\n", table);
+
+            // Walked through kmap slots, so dropping it afterwards is a local invlpg.
+            kstd::InterruptGuard guard;
+
+            const uint32_t       length = table->length;
+            MADT*                madt   = reinterpret_cast<MADT*>(mm::vmm::kmap_local_span((uint32_t)table, length));
+
             lapic_base = madt->local_apic_addr;
-            LOG_INFO("[apic] MADT found at 0x%08x\n", madt);
-            mm::vmm::map_identity_page((uint32_t)madt, mm::Flags::Present | mm::Flags::Writable);
 
             madt::entX* ent        = reinterpret_cast<madt::entX*>(reinterpret_cast<uint8_t*>(madt) + sizeof(MADT));;
             int32_t     size_bytes = madt->length - sizeof(MADT);
@@ -332,7 +365,7 @@ class apic : public NonTransferable {
                         ioapics.emplace(*ent1);
 
                         mm::vmm::map_identity_page((uint32_t)ent1->ioapic.base,
-                            mm::Flags::Present | mm::Flags::Writable);
+                            mm::Flags::Present | mm::Flags::Writable, mm::MemoryType::Uncached);
                         break;
                     }
                     case madt::ent_type::IOAPIC_ISR_OVERRIDE: {
@@ -374,10 +407,10 @@ class apic : public NonTransferable {
                 size_bytes -= current_length;
             }
 
-            mm::vmm::unmap_page((uint32_t)madt);
+            mm::vmm::kunmap_local_span((uint32_t)madt, length);
 
             LOG_INFO("[apic] LAPIC base: 0x%08x\n", lapic_base);
-            mm::vmm::map_identity_page(lapic_base, mm::Flags::Present | mm::Flags::Writable);
+            mm::vmm::map_identity_page(lapic_base, mm::Flags::Present | mm::Flags::Writable, mm::MemoryType::Uncached);
         }
 
         void configure() {
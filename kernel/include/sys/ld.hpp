@@ -1,24 +1,19 @@
 #pragma once
 
 #include <klibcpp/cstdint.hpp>
-#include <klibcpp/spinlock.hpp>
 #include <klibcpp/static_array.hpp>
 #include <klibcpp/elf.hpp>
 #include <klibcpp/trivial.hpp>
-#include <klibcpp/bitmap.hpp>
+#include <klibcpp/object_cache.hpp>
 #include <sys/kexp.hpp>
 #include <mm/layout.hpp>
 #include <mm/vmm.hpp>
+#include <mm/vspace.hpp>
+#include <sched/sync.hpp>
 #include <log.hpp>
 
 using namespace kstd::ELF32;
 
-using LMM = FixedBitmapAllocator<
-    mm::layout::virt::MODULE_SPACE_BASE,
-    mm::layout::virt::MODULE_SPACE_PAGE_COUNT,
-    mm::PAGE_SIZE
->;
-
 class Linker : public NonTransferable {
     public:
         enum class Access : uint8_t {
@@ -86,7 +81,7 @@ class Linker : public NonTransferable {
                 Section* c = section;
                 while (c) {
                     Section* n = c->next;
-                    delete c;
+                    sections.destroy(c);
                     c = n;
                 }
                 section = nullptr;
@@ -156,9 +151,7 @@ class Linker : public NonTransferable {
 
         kstd::StaticArray<Layout, 64> layouts;
 
-        Linker() {
-            mem_mngr.clear();
-        }
+        Linker() = default;
 
         ~Linker();
 
@@ -166,12 +159,14 @@ class Linker : public NonTransferable {
         void    unload(Layout* layout);
 
     private:
-        kstd::SpinLock lock_;
-        LMM mem_mngr;
+        // Linking maps and copies whole modules; a mutex keeps interrupts on meanwhile.
+        sched::Mutex lock_;
+
+        inline static kstd::ObjectCache<Section> sections{"linker-section"};
 
         bool    stage0(Layout* layout, Object* obj);
         bool    stage1(Region* reg, Object* obj);
         bool    stage2(Layout* layout);
         void    unload_locked(Layout* layout);
-        void    unload_region_locked(Region& reg);
+        void    unload_region_locked(Region& reg, mm::TlbBatch& batch);
 };
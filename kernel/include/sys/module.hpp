@@ -2,12 +2,12 @@
 
 #include "sys/smp.hpp"
 #include <klibcpp/cstdint.hpp>
-#include <klibcpp/spinlock.hpp>
 #include <klibcpp/elf.hpp>
 #include <klibcpp/static_array.hpp>
 #include <klibcpp/static_slot.hpp>
 #include <klibcpp/trivial.hpp>
 #include <sys/ld.hpp>
+#include <sched/sync.hpp>
 #include <log.hpp>
 
 using namespace kstd::ELF32;
@@ -29,7 +29,7 @@ class ModuleManager : public NonTransferable {
             : _linker(linker) {};
 
         ~ModuleManager() {
-            kstd::InterruptSpinLockGuard guard(lock_);
+            sched::MutexGuard guard(lock_);
 
             for (auto& module : modules) {
                 if (reinterpret_cast<uint32_t>(module.exit) >= 0x1000)
@@ -43,7 +43,7 @@ class ModuleManager : public NonTransferable {
         }
 
         bool registerModule(void* ptr) {
-            kstd::InterruptSpinLockGuard guard(lock_);
+            sched::MutexGuard guard(lock_);
 
             Object* obj = Object::create(ptr);
             if (!obj) {
@@ -82,7 +82,8 @@ class ModuleManager : public NonTransferable {
         }
 
     private:
-        kstd::SpinLock lock_;
+        // Held across linking and module_enter, which may run for a long time.
+        sched::Mutex lock_;
         Linker* _linker;
         kstd::StaticArray<Module, 64> modules;
 };
@@ -9,11 +9,14 @@
 #include <driver/serial.hpp>
 #include <driver/pit.hpp>
 #include <sys/apic.hpp>
+#include <mm/pmm.hpp>
+#include <mm/vmm.hpp>
 
 __extern_c gdt::Ptr       smp_gdt_ptr;
 __extern_c idt::Ptr       smp_idt_ptr;
 __extern_c uint32_t       smp_stack_top;
 __extern_c uint32_t       smp_pd_phy_addr;
+__extern_c uint32_t       smp_cr4;
 
 static constexpr uint32_t CORE_STACK_SIZE = 4096;
 
@@ -44,22 +47,36 @@ namespace smp {
     };
 
     struct Core : public NonTransferable {
-        const uint8_t      id; // Logical ID
-        const uint8_t      apic_id;
-        const bool         is_bsp;
-
-        kstd::Atomic<bool> initialized;
-        LAPIC              lapic;
-        Kernel*            kernel_;
-        StackDescriptor    stack;
+        const uint8_t              id; // Logical ID
+        const uint8_t              apic_id;
+        const bool                 is_bsp;
+
+        kstd::Atomic<bool>         initialized;
+        kstd::Atomic<mm::TlbState> tlb_state;
+        // Set by flush_remote_tlbs(), cleared by whichever of the IPI and vmm::answer_shootdown() runs first.
+        kstd::Atomic<bool>         tlb_shootdown_owed;
+        LAPIC                      lapic;
+        Kernel*                    kernel_;
+        StackDescriptor            stack;
+        mm::FrameCache             frame_cache;
+        sched::Scheduler*          scheduler_;
+        // Set by a handler under a context_switch stub to resume another saved frame; taken by idt::resume_frame().
+        idt::InterruptFrame*       switch_frame;
         alignas(16) char fxsave_region[512];
 
         Core(Kernel* kernel, uint32_t lapic_base, uint8_t id, uint8_t apic_id, bool is_bsp)
-            : id(id), apic_id(apic_id), is_bsp(is_bsp), initialized(false), lapic(lapic_base), kernel_(kernel),
-              fxsave_region{} {}
+            : id(id), apic_id(apic_id), is_bsp(is_bsp), initialized(false), tlb_state(mm::TlbState::Active),
+              tlb_shootdown_owed(false), lapic(lapic_base), kernel_(kernel), frame_cache(), scheduler_(nullptr), switch_frame(nullptr), fxsave_region{} {}
 
         Kernel&           kernel();
         sched::Scheduler& scheduler();
+
+        bool has_scheduler() const {
+            return scheduler_ != nullptr;
+        }
+
+        // Builds this core's run queue and starts its timer; must run on this core.
+        void start_scheduler();
     };
 
     template<uint32_t N>
@@ -129,6 +146,7 @@ namespace smp {
                 memcpy((uint8_t*)&smp_idt_ptr, (uint8_t*)&idt::ptr, sizeof(idt::Ptr));
 
                 smp_pd_phy_addr = mm::vmm::kernel_dir_phys;
+                smp_cr4         = mm::vmm::paging_features();
             }
 
             void init_bsp() {
@@ -154,6 +172,9 @@ namespace smp {
                 }
             }
 
+            // Stops every core's scheduler; remote cores stop switching on their next tick.
+            void stop_schedulers();
+
             static inline StackAnchor* current_anchor() {
                 uint32_t esp;
                 asm volatile ("mov %%esp, %0" : "=r"(esp));
@@ -189,15 +210,22 @@ namespace smp {
             }
 
             static void _pause() {
-                __asm__ volatile (
-                     "1:\n"
-                     "    sti\n"
-                     "    hlt\n"
-                     "    jmp 1b\n"
-                     :
-                     :
-                     : "memory"
-                );
+                while (true) {
+                    // Parked cores top up the zeroed-frame pool every time they wake.
+                    mm::pmm::prezero_frames(mm::ZERO_POOL_SIZE);
+
+                    // The sti shadow keeps the lazy window down to the hlt itself.
+                    __cli();
+                    mm::vmm::enter_lazy_tlb(*current_core());
+
+                    __asm__ volatile (
+                         "sti\n"
+                         "hlt\n"
+                         :
+                         :
+                         : "memory"
+                    );
+                }
             }
 
         private:
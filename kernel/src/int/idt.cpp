@@ -57,6 +57,9 @@ namespace idt {
             ? reinterpret_cast<FXSaveRegion*>(&current_core->fxsave_region)
             : &bootstrap_fxsave_region;
 
+        if (current_core)
+            mm::vmm::leave_lazy_tlb(*current_core);
+
         __asm__ volatile (" fxsave %0 " ::"m" (*fxsave_region));
 
         if(no >= 32 && no < 48) { // IRQ
@@ -85,6 +88,16 @@ namespace idt {
             current_core->lapic.EOI();
     }
 
+    InterruptFrame* resume_frame(InterruptFrame* saved) {
+        smp::Core* current_core = smp::CoreManager::current_anchor()->core;
+        if (!current_core || !current_core->switch_frame)
+            return saved;
+
+        InterruptFrame* next = current_core->switch_frame;
+        current_core->switch_frame = nullptr;
+        return next;
+    }
+
     void flush(const Ptr* idtr) {
         __asm__ volatile (
              "movl %0, %%eax\n"
@@ -17,6 +17,7 @@
 #include <driver/serial.hpp>
 #include <sys/acpi.hpp>
 #include <sys/kexp.hpp>
+#include <mm/vspace.hpp>
 #include <multiboot_utils.hpp>
 #include <log.hpp>
 
@@ -32,6 +33,8 @@ __extern_c {
 KernelAPI api;
 
 EXPORT_SYMBOL("api", api);
+EXPORT_SYMBOL("kheap_stats", kheap_stats);
+EXPORT_SYMBOL("kheap_dump", kheap_dump);
 
 static Kernel* g_kernel = nullptr;
 alignas(Kernel) static uint8_t kernel_storage[sizeof(Kernel)];
@@ -60,6 +63,7 @@ void Kernel::init(multiboot_info_t* mboot) {
 
     mm::pmm::init(&_mboot);
     mm::vmm::init();
+    mm::vspace::init();
     acpi::init();
 
     /*
@@ -67,8 +71,13 @@ void Kernel::init(multiboot_info_t* mboot) {
         will result in a page fault or other undefined behavior.
     */
     constexpr const auto& heap_region = mm::layout::virt::region<mm::layout::virt::RegionId::KernelHeap>();
+#if defined(KERNEL_LAZY_HEAP)
+    constexpr bool        lazy_heap   = true;
+#else
+    constexpr bool        lazy_heap   = false;
+#endif
     _heap.construct(heap_region.base, HEAP_MIN_SIZE, static_cast<uint32_t>(heap_region.end()),
-        mm::Present | mm::Writable);
+        mm::Present | mm::Writable, lazy_heap);
 
     _linker.construct();
     _mmanager.construct(_linker.ptr_if_constructed());
@@ -92,6 +101,7 @@ void Kernel::init(multiboot_info_t* mboot) {
         user-defined or hardware interrupts will be ignored.
     */
     __sti();
+    sched::Scheduler::install();
     _cmanager->init();
 
     /*
@@ -105,8 +115,9 @@ void Kernel::init(multiboot_info_t* mboot) {
     LOG_INFO("[cpp] _init()\n");
     _init();
 
-    _sched.construct();
-    _sched->yield();
+    smp::Core* bsp = smp::CoreManager::current_core();
+    bsp->start_scheduler();
+    bsp->scheduler().yield();
 }
 
 Kernel::~Kernel() {
@@ -122,11 +133,14 @@ Kernel::~Kernel() {
     LOG_INFO("[cpp] _fini()\n");
     _fini();
 
-    _sched.try_destruct();
-    _cmanager.try_destruct();
-    _apic.try_destruct();
+    if (_cmanager.constructed())
+        _cmanager->stop_schedulers();
+
+    // Module and linker teardown take sched::Mutex, which still looks up the current core.
     _mmanager.try_destruct();
     _linker.try_destruct();
+    _cmanager.try_destruct();
+    _apic.try_destruct();
     _heap.try_destruct();
 }
 
@@ -147,7 +161,7 @@ void kernel_main() {
 }
 
 __extern_c {
-    __cdecl void* _kmalloc(uint32_t size, bool align) {
+    __cdecl void* _kmalloc(uint32_t size, uint32_t align) {
         return (void*)heap_malloc(&g_kernel->_heap.get(), size, align);
     }
 
@@ -155,6 +169,19 @@ __extern_c {
         heap_free(&g_kernel->_heap.get(), ptr);
     }
 
+    __cdecl void* _krealloc(void* ptr, uint32_t size) {
+        return heap_realloc(&g_kernel->_heap.get(), ptr, size);
+    }
+
+    __cdecl void kheap_stats(HeapStats* out) {
+        if (out)
+            g_kernel->_heap->stats(*out);
+    }
+
+    __cdecl void kheap_dump() {
+        g_kernel->_heap->dump();
+    }
+
     __cdecl uint32_t _get_ticks() {
         return pit::ticks();
     }
@@ -174,6 +201,7 @@ __extern_c {
         api.get_ticks = &_get_ticks;
         api.putc      = &_putc;
         api.panic     = &_panic;
+        api.krealloc  = &_krealloc;
     }
 
     void kernel_early_main(multiboot_info_t* mboot, uint32_t magic) {
@@ -2,6 +2,7 @@
 #include <mm/vmm.hpp>
 #include <mm/pmm.hpp>
 #include <klibcpp/kstd.hpp>
+#include <sys/smp.hpp>
 #include <log.hpp>
 
 #define SIZE_T_SIZE              (sizeof(size_t))
@@ -28,7 +29,14 @@
 
 #define chunksize(ptr)           ((ptr)->head & ~(FLAG_BITS))
 
-#define get_head(heap)           (&(heap)->head)
+#define SMALLBIN_SHIFT           (3U)
+#define LARGEBIN_SHIFT           (8U)
+#define MIN_LARGE_SIZE           (SIZE_T_ONE << LARGEBIN_SHIFT)
+
+#define is_small(s)              ((s) < MIN_LARGE_SIZE)
+#define small_index(s)           ((uint32_t)((s) >> SMALLBIN_SHIFT))
+#define idx2bit(i)               (1U << (i))
+#define bits_above(i)            (~((2U << (i)) - 1U))
 
 #define chunk2mem(ptr)           ((void*)((char*)(ptr) + TWO_SIZE_T_SIZES))
 #define mem2chunk(ptr)           ((HeapChunk_t*)((char*)(ptr) - TWO_SIZE_T_SIZES))
@@ -52,6 +60,13 @@
     ((p)->head = (((p)->head & PINUSE_BIT)|CINUSE_BIT|(s)), \
     (chunk_plus_offset(p, s))->head |= PINUSE_BIT)
 
+#define set_cinuse(p, s) \
+    ((p)->head = (((p)->head & PINUSE_BIT)|CINUSE_BIT|(s)))
+
+// set_inuse() for chunks that may end the heap, where there is no successor to mark.
+#define set_inuse_bounded(h, p, s) \
+    (((size_t)chunk_plus_offset(p, s) < (h)->endAddr) ? set_inuse(p, s) : set_cinuse(p, s))
+
 #define set_size_and_pinuse(p, s) \
     ((p)->head = ((s)|PINUSE_BIT))
 
@@ -66,18 +81,16 @@ namespace {
         if (!size)
             return;
 
-        uint32_t pages = size / mm::PAGE_SIZE;
-        uint32_t phys  = mm::pmm::alloc_frames(pages);
-
-        mm::vmm::map_pages(virt_addr, phys, pages, perms | mm::Flags::Present);
+        if (!mm::vmm::map_alloc(virt_addr, size / mm::PAGE_SIZE, perms | mm::Flags::Present))
+            kstd::panic("heap: out of physical memory at 0x%08x\n", virt_addr);
     }
 }
 
-uint32_t heap_malloc(Heap* heap, uint32_t size, uint8_t align) {
+uint32_t heap_malloc(Heap* heap, uint32_t size, uint32_t align) {
     if (heap) {
         uint32_t addr;
         if (align)
-            addr = (uint32_t)heap->palignedAlloc(size);
+            addr = (uint32_t)heap->alloc_aligned(size, align);
         else
             addr = (uint32_t)heap->alloc(size);
 
@@ -92,42 +105,141 @@ void heap_free(Heap* heap, void* addr) {
         heap->free(addr);
 }
 
+void* heap_realloc(Heap* heap, void* addr, uint32_t size) {
+    if (heap)
+        return heap->realloc(addr, size);
+
+    return 0;
+}
+
+uint32_t Heap::largeBinIndex(size_t size) {
+    const size_t x = size >> LARGEBIN_SHIFT;
+    if (x == 0)
+        return 0;
+
+    if (x > 0xFFFF)
+        return NLARGEBINS - 1;
+
+    const uint32_t k = 31 - __builtin_clz(x);
+    return (k << 1) + ((size >> (k + LARGEBIN_SHIFT - 1)) & 1);
+}
+
 HeapChunk_t* Heap::findSmallestChunk(size_t size) {
-    HeapChunk_t*      tmp = 0;
-    struct list_head* iter;
-    list_for_each(iter, get_head(this)) {
-        tmp = list_entry(iter, HeapChunk_t, list);
-        if (chunksize(tmp) >= size)
-            break;
+    uint32_t bits;
+
+    if (is_small(size)) {
+        bits = smallmap & (~0U << small_index(size));
+        if (bits)
+            return list_entry(smallbins[__builtin_ctz(bits)].next, HeapChunk_t, list);
+
+        bits = largemap;
+    } else {
+        const uint32_t idx = largeBinIndex(size);
+
+        if (largemap & idx2bit(idx)) {
+            struct list_head* iter;
+            list_for_each(iter, &largebins[idx]) {
+                HeapChunk_t* tmp = list_entry(iter, HeapChunk_t, list);
+                if (chunksize(tmp) >= size)
+                    return tmp;
+            }
+        }
+
+        bits = largemap & bits_above(idx);
     }
 
-    if (iter == get_head(this))
+    if (!bits)
         return 0;
 
-    return tmp;
+    return list_entry(largebins[__builtin_ctz(bits)].next, HeapChunk_t, list);
+}
+
+void Heap::countAlloc(Counters& counters, size_t size) {
+    uint32_t cls = 31 - __builtin_clz(size) - 4;
+    if (cls >= HEAP_STATS_SIZE_CLASSES)
+        cls = HEAP_STATS_SIZE_CLASSES - 1;
+
+    ++counters.allocs;
+    ++counters.sizeClasses[cls];
+}
+
+// Faults above the current end are bugs, not growth.
+bool Heap::backsAddress(void* heap, uint32_t addr) {
+    return addr < static_cast<Heap*>(heap)->endAddr;
+}
+
+void Heap::accountInUse(size_t added, size_t removed) {
+    inUseBytes += added;
+    inUseBytes -= removed;
+
+    if (inUseBytes > peakBytes)
+        peakBytes = inUseBytes;
+}
+
+uint32_t Heap::largestFreeChunk() {
+    // Large bins are sorted by size, so the top one ends with the largest chunk.
+    if (largemap)
+        return chunksize(list_entry(largebins[31 - __builtin_clz(largemap)].prev, HeapChunk_t, list));
+
+    if (smallmap)
+        return (31 - __builtin_clz(smallmap)) << SMALLBIN_SHIFT;
+
+    return 0;
 }
 
 void Heap::insertChunk(HeapChunk_t* chunk) {
-    if (list_empty(get_head(this)))
-        list_add_tail(&(chunk->list), get_head(this));
-    else {
-        struct list_head* iter;
-        size_t            csize = chunksize(chunk);
-        list_for_each(iter, get_head(this)) {
-            HeapChunk_t* tmp = list_entry(iter, HeapChunk_t, list);
-            if (chunksize(tmp) >= csize)
-                break;
-        }
+    size_t csize = chunksize(chunk);
+
+    ++freeChunks;
+    freeBytes += csize;
+
+    if ((size_t)chunk_plus_offset(chunk, csize) == this->endAddr)
+        top = chunk;
 
-        list_add_tail(&(chunk->list), iter);
+    if (is_small(csize)) {
+        const uint32_t idx = small_index(csize);
+
+        list_add(&(chunk->list), &smallbins[idx]);
+        smallmap |= idx2bit(idx);
+        return;
+    }
+
+    // Keep large bins sorted; equal sizes are taken newest first.
+    const uint32_t    idx = largeBinIndex(csize);
+    struct list_head* iter;
+    list_for_each(iter, &largebins[idx]) {
+        HeapChunk_t* tmp = list_entry(iter, HeapChunk_t, list);
+        if (chunksize(tmp) >= csize)
+            break;
     }
+
+    list_add_tail(&(chunk->list), iter);
+    largemap |= idx2bit(idx);
 }
 
 void Heap::removeChunk(HeapChunk_t* chunk) {
+    size_t csize = chunksize(chunk);
+
     __list_del_entry(&(chunk->list));
+
+    --freeChunks;
+    freeBytes -= csize;
+
+    if (chunk == top)
+        top = 0;
+
+    if (is_small(csize)) {
+        const uint32_t idx = small_index(csize);
+        if (list_empty(&smallbins[idx]))
+            smallmap &= ~idx2bit(idx);
+    } else {
+        const uint32_t idx = largeBinIndex(csize);
+        if (list_empty(&largebins[idx]))
+            largemap &= ~idx2bit(idx);
+    }
 }
 
-Heap::Heap(uint32_t start, uint32_t size, uint32_t max, uint16_t perms) {
+Heap::Heap(uint32_t start, uint32_t size, uint32_t max, uint16_t perms, bool lazy) {
     size = align_heap_size(size);
     uint32_t end = start + size;
     assert(start % mm::PAGE_SIZE == 0);
@@ -137,9 +249,33 @@ Heap::Heap(uint32_t start, uint32_t size, uint32_t max, uint16_t perms) {
     this->endAddr   = end;
     this->maxAddr   = max;
     this->perms		= perms;
-    INIT_LIST_HEAD(get_head(this));
-
-    map_heap_backing(start, size, this->perms);
+    this->lazy      = lazy;
+    this->smallmap  = 0;
+    this->largemap  = 0;
+    this->top       = 0;
+
+    memset((uint8_t*)&this->counters, 0, sizeof(Counters));
+    this->reallocs   = 0;
+    this->expands    = 0;
+    this->contracts  = 0;
+    this->inUseBytes = 0;
+    this->peakBytes  = 0;
+    this->freeBytes  = 0;
+    this->freeChunks = 0;
+
+    for (uint32_t i = 0; i < NSMALLBINS; ++i)
+        INIT_LIST_HEAD(&smallbins[i]);
+
+    for (uint32_t i = 0; i < NLARGEBINS; ++i)
+        INIT_LIST_HEAD(&largebins[i]);
+
+    for (uint32_t i = 0; i < smp::CoreManager::MAX_CORES; ++i)
+        cpuCaches[i] = 0;
+
+    if (!lazy)
+        map_heap_backing(start, size, this->perms);
+    else if (!mm::vmm::reserve_lazy(start, max - start, this->perms, backsAddress, this))
+        kstd::panic("heap: no room to reserve 0x%08x lazily\n", start);
 
     HeapChunk_t* hole = (HeapChunk_t*)start;
     hole->prevFoot = 0;
@@ -148,7 +284,7 @@ Heap::Heap(uint32_t start, uint32_t size, uint32_t max, uint16_t perms) {
 }
 
 void Heap::expand(size_t newSize) {
-    kstd::InterruptSpinLockGuard guard(lock);
+    LockGuard guard(lock);
     expand_unlocked(newSize);
 }
 
@@ -163,11 +299,13 @@ void Heap::expand_unlocked(size_t newSize) {
     this->endAddr = this->startAddr + newSize;
 
     size_t size = this->endAddr - oldEnd;
-    map_heap_backing(oldEnd, size, this->perms);
+    if (!this->lazy)
+        map_heap_backing(oldEnd, size, this->perms);
+    ++this->expands;
 }
 
 size_t Heap::contract(size_t newSize) {
-    kstd::InterruptSpinLockGuard guard(lock);
+    LockGuard guard(lock);
     return contract_unlocked(newSize);
 }
 
@@ -186,8 +324,11 @@ size_t Heap::contract_unlocked(size_t newSize) {
     if (!size)
         return newSize;
 
+    ++this->contracts;
+
+    // Untouched pages of a lazy heap were never backed.
     uint32_t phys = mm::vmm::virt_to_phys(this->endAddr);
-    if (phys == 0xFFFFFFFF)
+    if (phys == 0xFFFFFFFF && !this->lazy)
         LOG_WARN("[heap] trying to free unmapped memory! addr: 0x%08x\n", this->endAddr);
 
     mm::vmm::unmap_pages(this->endAddr, size / mm::PAGE_SIZE);
@@ -195,8 +336,66 @@ size_t Heap::contract_unlocked(size_t newSize) {
     return newSize;
 }
 
+Heap::CpuCache* Heap::localCache() {
+    if (!smp::CoreManager::instance())
+        return 0;
+
+    smp::Core* core = smp::CoreManager::current_anchor()->core;
+    if (!core)
+        return 0;
+
+    CpuCache*& cache = cpuCaches[core->id];
+    if (!cache) {
+        LockGuard guard(lock);
+        cache = (CpuCache*)alloc_unlocked(sizeof(CpuCache));
+        memset((uint8_t*)cache, 0, sizeof(CpuCache));
+    }
+
+    return cache;
+}
+
+void Heap::refillMagazine(CpuCache::Magazine& mag, size_t size) {
+    LockGuard guard(lock);
+
+    // Filled top down so the lowest chunk is handed out first.
+    for (uint32_t i = CpuCache::BATCH; i-- > 0;)
+        mag.chunks[i] = mem2chunk(alloc_unlocked(size));
+
+    mag.count = CpuCache::BATCH;
+}
+
+void Heap::flushMagazine(CpuCache::Magazine& mag) {
+    LockGuard guard(lock);
+
+    // Return the oldest half; the newest chunks are the likeliest to be hot.
+    for (uint32_t i = 0; i < CpuCache::BATCH; ++i)
+        free_unlocked(chunk2mem(mag.chunks[i]));
+
+    for (uint32_t i = CpuCache::BATCH; i < mag.count; ++i)
+        mag.chunks[i - CpuCache::BATCH] = mag.chunks[i];
+
+    mag.count -= CpuCache::BATCH;
+}
+
 void* Heap::alloc(size_t size) {
-    kstd::InterruptSpinLockGuard guard(lock);
+    const size_t nb = request2size(size);
+
+    if (is_small(nb)) {
+        kstd::InterruptGuard guard;
+
+        CpuCache*            cache = localCache();
+        if (cache) {
+            CpuCache::Magazine& mag = cache->classes[small_index(nb)];
+            if (!mag.count)
+                refillMagazine(mag, size);
+
+            countAlloc(cache->counters, nb);
+            return chunk2mem(mag.chunks[--mag.count]);
+        }
+    }
+
+    LockGuard guard(lock);
+    countAlloc(counters, nb);
     return alloc_unlocked(size);
 }
 
@@ -209,30 +408,19 @@ void* Heap::alloc_unlocked(size_t size) {
         size_t oldEndAddr = this->endAddr;
         expand_unlocked(oldSize + nb);
 
-        struct list_head* tmp = 0;
-        if (!list_empty(get_head(this))) {
-            struct list_head* iter;
-            list_for_each(iter, get_head(this)) {
-                if (iter > tmp)
-                    tmp = iter;
-            }
-        }
-
-        HeapChunk_t* topChunk = 0;
+        // A public expand() can move endAddr past the recorded top chunk.
+        HeapChunk_t* topChunk = top;
         size_t       csize    = 0;
 
-        if (tmp) {
-            topChunk = list_entry(tmp, HeapChunk_t, list);
+        if (topChunk && (size_t)chunk_plus_offset(topChunk, chunksize(topChunk)) != oldEndAddr)
+            topChunk = 0;
+
+        if (topChunk) {
             if (!pinuse(topChunk) && cinuse(topChunk))
                 goto _Lassert;
 
-            size_t oldCsize = chunksize(topChunk);
-            if ((size_t)chunk_plus_offset(topChunk, oldCsize) != oldEndAddr)
-                topChunk = 0;
-            else {
-                removeChunk(topChunk);
-                csize = this->endAddr - (size_t)topChunk;
-            }
+            removeChunk(topChunk);
+            csize = this->endAddr - (size_t)topChunk;
         }
 
         if (topChunk == 0) {
@@ -256,11 +444,16 @@ void* Heap::alloc_unlocked(size_t size) {
         HeapChunk_t* _new  = chunk_plus_offset(hole, nb);
         _new->head = nsize;
 
+        // The chunk after the hole still records the old hole size as its prevFoot.
+        if ((size_t)chunk_plus_offset(_new, nsize) < this->endAddr)
+            set_foot(_new, nsize);
+
         insertChunk(_new);
     } else
         nb = chunksize(hole);
 
-    set_inuse(hole, nb);
+    set_inuse_bounded(this, hole, nb);
+    accountInUse(nb, 0);
 
     return chunk2mem(hole);
 
@@ -270,7 +463,42 @@ _Lassert:
 }
 
 void Heap::free(void* ptr) {
-    kstd::InterruptSpinLockGuard guard(lock);
+    if (ptr == 0)
+        return;
+
+    // Checked before the magazine path too, so a foreign pointer is never cached and handed out again.
+    if (!ok_address(ptr, this))
+        kstd::panic("(free) Memory Corrupt");
+
+    HeapChunk_t* block = mem2chunk(ptr);
+    size_t       size  = chunksize(block);
+
+    if (is_small(size)) {
+        if (!ok_inuse(block))
+            kstd::panic("(free) Memory Corrupt");
+
+        kstd::InterruptGuard guard;
+
+        CpuCache*            cache = localCache();
+        if (cache) {
+            CpuCache::Magazine& mag = cache->classes[small_index(size)];
+
+            for (uint32_t i = 0; i < mag.count; ++i) {
+                if (mag.chunks[i] == block)
+                    kstd::panic("(free) Double free");
+            }
+
+            if (mag.count == CpuCache::MAGAZINE_SIZE)
+                flushMagazine(mag);
+
+            mag.chunks[mag.count++] = block;
+            ++cache->counters.frees;
+            return;
+        }
+    }
+
+    LockGuard guard(lock);
+    ++counters.frees;
     free_unlocked(ptr);
 }
 
@@ -288,6 +516,8 @@ void Heap::free_unlocked(void* ptr) {
     if (!ok_inuse(block))
         goto _Lassert;
 
+    accountInUse(0, size);
+
     if (!pinuse(block)) {
         size_t       prevsize = block->prevFoot;
         HeapChunk_t* prev     = chunk_minus_offset(block, prevsize);
@@ -326,7 +556,11 @@ void Heap::free_unlocked(void* ptr) {
         if (newSize % mm::PAGE_SIZE)
             newSize += MIN_CHUNK_SIZE;
 
-        newSize = contract_unlocked(newSize);
+        // A tail that does not free a whole page stays in the bins.
+        if (align_heap_size(newSize) < oldSize)
+            newSize = contract_unlocked(newSize);
+        else
+            newSize = oldSize;
 
         if (size > oldSize - newSize)
             size -= oldSize - newSize;
@@ -350,50 +584,209 @@ _Lassert:
     kstd::panic("(free) Memory Corrupt");
 }
 
+void* Heap::realloc(void* ptr, size_t size) {
+    if (ptr == 0)
+        return alloc(size);
+
+    if (size == 0) {
+        free(ptr);
+        return 0;
+    }
+
+    HeapChunk_t* block = mem2chunk(ptr);
+    size_t       csize = chunksize(block);
+
+    {
+        LockGuard guard(lock);
+
+        if (!ok_address(ptr, this) || !cinuse(block))
+            kstd::panic("(realloc) Memory Corrupt");
+
+        ++reallocs;
+
+        if (resize_unlocked(block, request2size(size)))
+            return ptr;
+    }
+
+    void* mem = alloc(size);
+    if (mem) {
+        size_t usable = csize - CHUNK_OVERHEAD;
+        memcpy((uint8_t*)mem, (uint8_t*)ptr, usable < size ? usable : size);
+        free(ptr);
+    }
+
+    return mem;
+}
+
+/*
+    Resizes an in-use chunk without moving it: shrinking splits off the tail,
+    growing absorbs a free successor and, for the last chunk, expands the heap.
+    Returns false when the chunk has to move.
+*/
+bool Heap::resize_unlocked(HeapChunk_t* block, size_t nb) {
+    size_t       csize = chunksize(block);
+    HeapChunk_t* next  = chunk_plus_offset(block, csize);
+
+    if (csize < nb) {
+        const bool merge = ok_address(next, this) && !cinuse(next);
+        size_t     avail = merge ? csize + chunksize(next) : csize;
+
+        if (avail < nb) {
+            if ((size_t)block + avail != this->endAddr)
+                return false;
+
+            size_t newSize = (this->endAddr - this->startAddr) + (nb - avail);
+            if (this->startAddr + align_heap_size(newSize) > this->maxAddr)
+                return false;
+
+            expand_unlocked(newSize);
+            avail = this->endAddr - (size_t)block;
+        }
+
+        if (merge)
+            removeChunk(next);
+
+        accountInUse(avail - csize, 0);
+        csize = avail;
+        set_inuse_bounded(this, block, csize);
+    }
+
+    if (csize >= nb + MIN_CHUNK_SIZE) {
+        size_t       remainderSize = csize - nb;
+        HeapChunk_t* remainder     = chunk_plus_offset(block, nb);
+        set_inuse(block, nb);
+        set_inuse_bounded(this, remainder, remainderSize);
+        free_unlocked(chunk2mem(remainder));
+    }
+
+    return true;
+}
+
 void* Heap::palignedAlloc(size_t size) {
-    kstd::InterruptSpinLockGuard guard(lock);
-    return palignedAlloc_unlocked(size);
+    return alloc_aligned(size, mm::PAGE_SIZE);
+}
+
+void* Heap::alloc_aligned(size_t size, size_t align) {
+    if (!align || (align & (align - 1)))
+        kstd::panic("(alloc_aligned) Alignment %u is not a power of two", align);
+
+    if (align <= KMALLOC_ALIGNMENT)
+        return alloc(size);
+
+    LockGuard guard(lock);
+    countAlloc(counters, request2size(size));
+    return alloc_aligned_unlocked(size, align);
 }
 
-void* Heap::palignedAlloc_unlocked(size_t size) {
+/*
+    Over-allocates by `align` plus room for a lead chunk, then gives the slack
+    in front of the aligned address and past the request back to the bins.
+*/
+void* Heap::alloc_aligned_unlocked(size_t size, size_t align) {
     size_t nb  = request2size(size);
-    size_t req = nb + mm::PAGE_SIZE + MIN_CHUNK_SIZE - CHUNK_OVERHEAD;
+    size_t req = nb + align + MIN_CHUNK_SIZE - CHUNK_OVERHEAD;
 
     void*  mem = alloc_unlocked(req);
     if (mem) {
         HeapChunk_t* chunk = mem2chunk(mem);
-        if ((size_t)mem % mm::PAGE_SIZE) {
-            char*        br       = (char*)mem2chunk(((size_t)mem & -mm::PAGE_SIZE) + mm::PAGE_SIZE);
-            char*        pos      = ((size_t)(br - (char*)(chunk)) >= MIN_CHUNK_SIZE) ? br : br + mm::PAGE_SIZE;
+        if ((size_t)mem % align) {
+            char*        br       = (char*)mem2chunk(((size_t)mem & -align) + align);
+            char*        pos      = ((size_t)(br - (char*)(chunk)) >= MIN_CHUNK_SIZE) ? br : br + align;
 
             HeapChunk_t* newChunk = (HeapChunk_t*)pos;
             size_t       leadsize = pos - (char*)(chunk);
             size_t       newSize  = chunksize(chunk) - leadsize;
 
-            set_inuse(newChunk, newSize);
+            set_inuse_bounded(this, newChunk, newSize);
+            clear_pinuse(newChunk);
 
             set_size_and_pinuse(chunk, leadsize);
             newChunk->prevFoot = leadsize;
 
             insertChunk(chunk);
+            accountInUse(0, leadsize);
 
             chunk = newChunk;
         }
 
         size_t csize = chunksize(chunk);
-        if (csize > nb + MIN_CHUNK_SIZE) {
+        if (csize >= nb + MIN_CHUNK_SIZE) {
             size_t       remainderSize = csize - nb;
             HeapChunk_t* remainder     = chunk_plus_offset(chunk, nb);
             set_inuse(chunk, nb);
-            set_inuse(remainder, remainderSize);
+            set_inuse_bounded(this, remainder, remainderSize);
             free_unlocked(chunk2mem(remainder));
         }
 
         mem = chunk2mem(chunk);
         assert(chunksize(chunk) >= nb);
-        assert(((size_t)mem % mm::PAGE_SIZE) == 0);
+        assert(((size_t)mem % align) == 0);
         assert(cinuse(chunk));
     }
 
     return mem;
 }
+
+/*
+    Counters kept by other cores' caches are read without their cooperation,
+    so the totals are only exact while the heap is quiet.
+*/
+void Heap::stats(HeapStats& out) {
+    LockGuard guard(lock);
+
+    memset((uint8_t*)&out, 0, sizeof(HeapStats));
+
+    out.heap_size          = this->endAddr - this->startAddr;
+    out.heap_max           = this->maxAddr - this->startAddr;
+    out.peak_bytes         = this->peakBytes;
+    out.free_bytes         = this->freeBytes;
+    out.free_chunks        = this->freeChunks;
+    out.largest_free_chunk = largestFreeChunk();
+    out.reallocs           = this->reallocs;
+    out.expands            = this->expands;
+    out.contracts          = this->contracts;
+
+    auto add = [&out](const Counters& counters) {
+        out.allocs += counters.allocs;
+        out.frees  += counters.frees;
+
+        for (uint32_t c = 0; c < HEAP_STATS_SIZE_CLASSES; ++c)
+            out.size_classes[c] += counters.sizeClasses[c];
+    };
+
+    add(this->counters);
+
+    for (uint32_t i = 0; i < smp::CoreManager::MAX_CORES; ++i) {
+        CpuCache* cache = cpuCaches[i];
+        if (!cache)
+            continue;
+
+        add(cache->counters);
+
+        for (uint32_t c = 0; c < NSMALLBINS; ++c) {
+            const CpuCache::Magazine& mag = cache->classes[c];
+            for (uint32_t j = 0; j < mag.count; ++j)
+                out.cached_bytes += chunksize(mag.chunks[j]);
+        }
+    }
+
+    out.in_use_bytes = this->inUseBytes - out.cached_bytes;
+}
+
+void Heap::dump() {
+    HeapStats s;
+    stats(s);
+
+    LOG_INFO("[heap] size 0x%08x of 0x%08x, %u expands, %u contracts\n",
+        s.heap_size, s.heap_max, s.expands, s.contracts);
+    LOG_INFO("[heap] in use %u bytes, cached %u bytes, peak %u bytes\n",
+        s.in_use_bytes, s.cached_bytes, s.peak_bytes);
+    LOG_INFO("[heap] free %u bytes in %u chunks, largest %u bytes\n",
+        s.free_bytes, s.free_chunks, s.largest_free_chunk);
+    LOG_INFO("[heap] %u allocs, %u frees, %u reallocs\n", s.allocs, s.frees, s.reallocs);
+
+    for (uint32_t i = 0; i < HEAP_STATS_SIZE_CLASSES; ++i) {
+        if (s.size_classes[i])
+            LOG_INFO("[heap]   %u+ bytes: %u\n", 16u << i, s.size_classes[i]);
+    }
+}
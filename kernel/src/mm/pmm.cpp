@@ -1,8 +1,10 @@
 #include <mm/pmm.hpp>
 #include <mm/layout.hpp>
+#include <mm/vmm.hpp>
 #include <multiboot.hpp>
 #include <multiboot_utils.hpp>
 #include <klibcpp/kstd.hpp>
+#include <sys/smp.hpp>
 #include <log.hpp>
 
 namespace mm {
@@ -10,6 +12,9 @@ namespace mm {
     kstd::SpinLock     pmm::lock;
     uint32_t           pmm::available_frames;
     uint32_t           pmm::used_frames;
+    kstd::SpinLock     pmm::zero_lock;
+    uint32_t           pmm::zeroed_count;
+    uint32_t           pmm::zeroed[ZERO_POOL_SIZE];
 
     static const char* typeNames[] = { "UNKNOWN", "AVAILABLE", "RESERVED", "ACPI", "NVS", "BAD MEMORY" };
 
@@ -87,8 +92,9 @@ namespace mm {
         available_frames = 0;
         used_frames      = 0;
 
-        mem_mngr.mark_units_used(0, MAX_FRAMES);
+        mem_mngr.set();
 
+        LOG_INFO("[pmm] Using %s backend\n", PMM_BACKEND_NAME);
         LOG_INFO("[pmm] Memory map provided by bootloader:\n");
         while ((uint32_t)mmap < mmap_end) {
             uint32_t base   = mmap->addr;
@@ -154,12 +160,41 @@ namespace mm {
     }
 
     uint32_t pmm::alloc_frames(uint32_t count) {
+        bool short_of_frames;
+        {
+            kstd::SpinLockGuard guard(lock);
+            short_of_frames = mem_mngr.free_unit_count() < count;
+        }
+
+        // Frames parked in the per-core magazines are still free memory.
+        if (short_of_frames)
+            reclaim_cached();
+
         kstd::SpinLockGuard guard(lock);
         uint32_t            addr = mem_mngr.alloc_units(count);
         used_frames += count;
         return addr;
     }
 
+    uint32_t pmm::alloc_frames_upto(uint32_t max, uint32_t& count) {
+        {
+            kstd::SpinLockGuard guard(lock);
+            uint32_t            addr = mem_mngr.alloc_units_upto(max, count);
+            used_frames += count;
+
+            if (count || !max)
+                return addr;
+        }
+
+        if (!reclaim_cached())
+            return 0;
+
+        kstd::SpinLockGuard guard(lock);
+        uint32_t            addr = mem_mngr.alloc_units_upto(max, count);
+        used_frames += count;
+        return addr;
+    }
+
     void pmm::free_frames(uint32_t base, uint32_t count) {
         kstd::SpinLockGuard guard(lock);
         mem_mngr.free_units(base, count);
@@ -167,11 +202,187 @@ namespace mm {
     }
 
     uint32_t pmm::alloc_frame() {
+        kstd::InterruptGuard guard;
+
+        FrameCache*          cache = local_cache();
+        if (!cache)
+            return alloc_frames(1);
+
+        {
+            kstd::SpinLockGuard cache_guard(cache->lock);
+
+            if (cache->hot->empty()) {
+                if (!cache->cold->empty())
+                    cache->swap();
+                else
+                    refill(*cache->hot);
+            }
+
+            FrameCache::Magazine& mag = *cache->hot;
+            if (!mag.empty())
+                return mag.frames[--mag.count];
+        }
+
+        // Dropped the cache lock first: reclaiming takes every core's, this one included.
         return alloc_frames(1);
     }
 
     void pmm::free_frame(uint32_t addr) {
-        free_frames(addr, 1);
+        kstd::InterruptGuard guard;
+
+        FrameCache*          cache = local_cache();
+        if (!cache) {
+            free_frames(addr, 1);
+            return;
+        }
+
+        kstd::SpinLockGuard cache_guard(cache->lock);
+
+        if (cache->hot->full()) {
+            if (!cache->cold->empty())
+                drain(*cache->cold);
+
+            cache->swap();
+        }
+
+        FrameCache::Magazine& mag = *cache->hot;
+        mag.frames[mag.count++] = addr;
+    }
+
+    uint32_t pmm::alloc_zeroed_frame() {
+        {
+            kstd::InterruptSpinLockGuard guard(zero_lock);
+            if (zeroed_count)
+                return zeroed[--zeroed_count];
+        }
+
+        const uint32_t addr = alloc_frame();
+        zero_frame(addr);
+        return addr;
+    }
+
+    /*
+        Tops up the zeroed pool by at most `budget` frames. Meant for idle
+        loops, so every frame is cleared with interrupts enabled between frames
+        and the pool lock is only held to publish the result.
+    */
+    uint32_t pmm::prezero_frames(uint32_t budget) {
+        uint32_t added = 0;
+
+        while (added < budget) {
+            {
+                kstd::InterruptSpinLockGuard guard(zero_lock);
+                if (zeroed_count >= ZERO_POOL_SIZE)
+                    break;
+            }
+
+            // Never let background zeroing take the last free frames.
+            {
+                kstd::SpinLockGuard guard(lock);
+                if (mem_mngr.free_unit_count() <= ZERO_POOL_SIZE)
+                    break;
+            }
+
+            const uint32_t addr = alloc_frame();
+            zero_frame(addr);
+
+            {
+                kstd::InterruptSpinLockGuard guard(zero_lock);
+                if (zeroed_count < ZERO_POOL_SIZE) {
+                    zeroed[zeroed_count++] = addr;
+                    ++added;
+                    continue;
+                }
+            }
+
+            free_frame(addr);
+            break;
+        }
+
+        return added;
+    }
+
+    void pmm::zero_frame(uint32_t addr) {
+        if (addr < layout::virt::IDENTITY_WINDOW_SIZE) {
+            memset(reinterpret_cast<uint8_t*>(addr), 0, PAGE_SIZE);
+            return;
+        }
+
+        kstd::InterruptGuard guard;
+
+        const uint32_t       virt = vmm::kmap_local(addr);
+        memset(reinterpret_cast<uint8_t*>(virt), 0, PAGE_SIZE);
+        vmm::kunmap_local(virt);
+    }
+
+    FrameCache* pmm::local_cache() {
+        if (!smp::CoreManager::instance())
+            return nullptr;
+
+        smp::Core* core = smp::CoreManager::current_anchor()->core;
+        return core ? &core->frame_cache : nullptr;
+    }
+
+    uint32_t pmm::cached_frames() {
+        smp::CoreManager* manager = smp::CoreManager::instance();
+        if (!manager)
+            return 0;
+
+        uint32_t cached = 0;
+        for (uint32_t i = 0; i < manager->core_count(); ++i)
+            cached += manager->core(i).frame_cache.cached();
+
+        return cached;
+    }
+
+    bool pmm::refill(FrameCache::Magazine& mag) {
+        kstd::SpinLockGuard guard(lock);
+
+        uint32_t            count = mem_mngr.free_unit_count();
+        if (count > FrameCache::MAGAZINE_SIZE)
+            count = FrameCache::MAGAZINE_SIZE;
+
+        for (uint32_t i = 0; i < count; ++i)
+            mag.frames[i] = mem_mngr.alloc_unit();
+
+        mag.count    = count;
+        used_frames += count;
+        return count != 0;
+    }
+
+    /*
+        Empties every core's magazines back into the allocator and returns how
+        many frames that freed. Runs before an allocation fails, so memory
+        parked on other cores never surfaces as out-of-memory. Called with
+        neither `lock` nor any cache lock held.
+    */
+    uint32_t pmm::reclaim_cached() {
+        smp::CoreManager* manager = smp::CoreManager::instance();
+        if (!manager)
+            return 0;
+
+        uint32_t reclaimed = 0;
+        for (uint32_t i = 0; i < manager->core_count(); ++i) {
+            FrameCache&                  cache = manager->core(i).frame_cache;
+            kstd::InterruptSpinLockGuard guard(cache.lock);
+
+            for (auto& mag : cache.magazines) {
+                reclaimed += mag.count;
+                drain(mag);
+            }
+        }
+
+        return reclaimed;
+    }
+
+    void pmm::drain(FrameCache::Magazine& mag) {
+        kstd::SpinLockGuard guard(lock);
+
+        for (uint32_t i = 0; i < mag.count; ++i)
+            mem_mngr.free_unit(mag.frames[i]);
+
+        used_frames -= mag.count;
+        mag.count    = 0;
     }
 
     bool pmm::frame_used(uint32_t addr) {
@@ -192,24 +403,17 @@ namespace mm {
         if (range.empty())
             return;
 
-        uint32_t used_before = 0;
-        for (uint32_t i = 0; i < range.frames; ++i) {
-            if (mem_mngr.allocated(range.base + i * PAGE_SIZE))
-                ++used_before;
-        }
-
-        mem_mngr.mark_units_used(range.base, range.frames);
-        used_frames += range.frames - used_before;
+        used_frames += mem_mngr.mark_units_used(range.base, range.frames);
     }
 
     uint32_t pmm::free_memory() {
         kstd::SpinLockGuard guard(lock);
-        return (available_frames - used_frames) * PAGE_SIZE;
+        return (available_frames - used_frames + cached_frames() + zeroed_count) * PAGE_SIZE;
     }
 
     uint32_t pmm::used_memory() {
         kstd::SpinLockGuard guard(lock);
-        return used_frames * PAGE_SIZE;
+        return (used_frames - cached_frames() - zeroed_count) * PAGE_SIZE;
     }
 
     uint32_t pmm::total_memory() {
@@ -0,0 +1,377 @@
+#include <mm/slab.hpp>
+#include <mm/pmm.hpp>
+#include <mm/vmm.hpp>
+#include <klibcpp/bitmap.hpp>
+#include <klibcpp/kstd.hpp>
+#include <sys/smp.hpp>
+#include <log.hpp>
+
+namespace mm {
+    /*
+        One descriptor per slab-space page. Only the first page of a slab
+        carries live state; every page records `head` so an object in any page
+        leads back to it.
+    */
+    struct Slab {
+        SlabCache* cache;
+        Slab*      prev;
+        Slab*      next;
+        void*      free;
+        uint16_t   inuse;
+        uint16_t   head;
+    };
+
+    using SlabSpace = FixedBitmapAllocator<
+        layout::virt::SLAB_SPACE_BASE,
+        layout::virt::SLAB_SPACE_PAGE_COUNT,
+        mm::PAGE_SIZE
+    >;
+
+    namespace {
+        SlabSpace      slab_space;
+        kstd::SpinLock slab_space_lock;
+        Slab           slab_table[layout::virt::SLAB_SPACE_PAGE_COUNT];
+    }
+
+    static uint32_t page_index(uint32_t addr) {
+        return (addr - layout::virt::SLAB_SPACE_BASE) / PAGE_SIZE;
+    }
+
+    static uint32_t slab_base(const Slab* slab) {
+        return layout::virt::SLAB_SPACE_BASE + static_cast<uint32_t>(slab - slab_table) * PAGE_SIZE;
+    }
+
+    static Slab* slab_of(const void* object) {
+        return &slab_table[slab_table[page_index(reinterpret_cast<uint32_t>(object))].head];
+    }
+
+    bool SlabCache::owns(const void* object) {
+        constexpr const auto& region = layout::virt::region<layout::virt::RegionId::SlabSpace>();
+        return region.contains(reinterpret_cast<uint32_t>(object));
+    }
+
+    void* SlabCache::alloc() {
+        while (true) {
+            {
+                kstd::InterruptGuard guard;
+
+                SlabCpuCache*        cache = local_cache();
+                if (!cache) {
+                    void* object = nullptr;
+                    if (refill(&object, 1))
+                        return object;
+                } else {
+                    if (!cache->hot->count) {
+                        if (cache->cold->count)
+                            cache->swap();
+                        else
+                            cache->hot->count = refill(cache->hot->objects, batch_);
+                    }
+
+                    SlabCpuCache::Magazine& mag = *cache->hot;
+                    if (mag.count)
+                        return mag.objects[--mag.count];
+                }
+            }
+
+            // Mapping a new slab shoots down remote TLBs, so it runs with
+            // interrupts restored and without the cache lock.
+            Slab* slab = grow();
+            if (!slab)
+                return nullptr;
+
+            kstd::InterruptSpinLockGuard guard(lock_);
+            adopt_locked(slab);
+        }
+    }
+
+    void SlabCache::free(void* object) {
+        if (!object)
+            return;
+
+        if (!owns(object) || slab_of(object)->cache != this)
+            kstd::panic("slab %s: freeing foreign object 0x%08x\n", name_, reinterpret_cast<uint32_t>(object));
+
+        Slab* released = nullptr;
+        {
+            kstd::InterruptGuard guard;
+
+            SlabCpuCache*        cache = local_cache();
+            if (!cache) {
+                released = flush(&object, 1);
+            } else {
+                if (cache->hot->count == batch_) {
+                    if (cache->cold->count) {
+                        released            = flush(cache->cold->objects, cache->cold->count);
+                        cache->cold->count  = 0;
+                    }
+
+                    cache->swap();
+                }
+
+                SlabCpuCache::Magazine& mag = *cache->hot;
+                mag.objects[mag.count++] = object;
+            }
+        }
+
+        release(released);
+    }
+
+    void SlabCache::shrink() {
+        Slab* released = nullptr;
+        {
+            kstd::InterruptGuard guard;
+
+            SlabCpuCache*        cache = local_cache();
+            if (cache) {
+                for (auto& mag : cache->magazines) {
+                    Slab* slabs = flush(mag.objects, mag.count);
+                    mag.count   = 0;
+
+                    while (slabs) {
+                        Slab* next = slabs->next;
+                        slabs->next = released;
+                        released    = slabs;
+                        slabs       = next;
+                    }
+                }
+            }
+
+            kstd::SpinLockGuard lock_guard(lock_);
+
+            Slab*               slab = partial_;
+            while (slab) {
+                Slab* next = slab->next;
+
+                if (!slab->inuse) {
+                    unlink_partial(slab);
+                    --empty_slabs_;
+                    --slab_count_;
+
+                    slab->next = released;
+                    released   = slab;
+                }
+
+                slab = next;
+            }
+        }
+
+        release(released);
+    }
+
+    uint32_t SlabCache::active_objects() {
+        kstd::InterruptSpinLockGuard guard(lock_);
+
+        uint32_t                     cached = 0;
+        for (auto* cache : cpu_caches_) {
+            if (cache)
+                cached += cache->cached();
+        }
+
+        return inuse_ - cached;
+    }
+
+    SlabCpuCache* SlabCache::local_cache() {
+        if (!smp::CoreManager::instance())
+            return nullptr;
+
+        smp::Core* core = smp::CoreManager::current_anchor()->core;
+        if (!core)
+            return nullptr;
+
+        SlabCpuCache*& cache = cpu_caches_[core->id];
+        if (!cache)
+            cache = new SlabCpuCache();
+
+        return cache;
+    }
+
+    uint32_t SlabCache::refill(void** objects, uint32_t want) {
+        kstd::SpinLockGuard guard(lock_);
+
+        uint32_t            count = 0;
+        while (count < want && partial_)
+            objects[count++] = take_locked();
+
+        return count;
+    }
+
+    // Returns the chain of slabs that were emptied beyond MAX_EMPTY_SLABS.
+    Slab* SlabCache::flush(void** objects, uint32_t count) {
+        kstd::SpinLockGuard guard(lock_);
+
+        Slab*               released = nullptr;
+        for (uint32_t i = 0; i < count; ++i) {
+            Slab* slab = put_locked(objects[i]);
+            if (!slab)
+                continue;
+
+            slab->next = released;
+            released   = slab;
+        }
+
+        return released;
+    }
+
+    void* SlabCache::take_locked() {
+        Slab* slab   = partial_;
+        void* object = slab->free;
+
+        slab->free = next_free(object);
+        if (!slab->inuse++)
+            --empty_slabs_;
+
+        if (!slab->free)
+            unlink_partial(slab);
+
+        ++inuse_;
+        return object;
+    }
+
+    Slab* SlabCache::put_locked(void* object) {
+        Slab* slab = slab_of(object);
+
+        if (!slab->free)
+            link_partial(slab);
+
+        next_free(object) = slab->free;
+        slab->free        = object;
+        --inuse_;
+
+        if (--slab->inuse)
+            return nullptr;
+
+        if (++empty_slabs_ <= MAX_EMPTY_SLABS)
+            return nullptr;
+
+        unlink_partial(slab);
+        --empty_slabs_;
+        --slab_count_;
+        return slab;
+    }
+
+    void SlabCache::adopt_locked(Slab* slab) {
+        link_partial(slab);
+        ++empty_slabs_;
+        ++slab_count_;
+    }
+
+    void SlabCache::link_partial(Slab* slab) {
+        slab->prev = nullptr;
+        slab->next = partial_;
+
+        if (partial_)
+            partial_->prev = slab;
+
+        partial_ = slab;
+    }
+
+    void SlabCache::unlink_partial(Slab* slab) {
+        if (slab->prev)
+            slab->prev->next = slab->next;
+        else
+            partial_ = slab->next;
+
+        if (slab->next)
+            slab->next->prev = slab->prev;
+
+        slab->prev = nullptr;
+        slab->next = nullptr;
+    }
+
+    Slab* SlabCache::grow() {
+        if (!slab_objects_ || align_ > PAGE_SIZE)
+            kstd::panic("slab %s: unsupported object size %u / align %u\n", name_, size_, align_);
+
+        uint32_t frames[MAX_SLAB_PAGES];
+        for (uint32_t i = 0; i < slab_pages_; ++i) {
+            frames[i] = pmm::alloc_frame();
+
+            if (!frames[i]) {
+                while (i--)
+                    pmm::free_frame(frames[i]);
+
+                LOG_WARN("[slab] %s: out of physical memory\n", name_);
+                return nullptr;
+            }
+        }
+
+        uint32_t base;
+        bool     placed;
+        {
+            kstd::InterruptSpinLockGuard guard(slab_space_lock);
+            placed = slab_space.try_alloc_units(slab_pages_, base);
+        }
+
+        if (!placed) {
+            for (uint32_t i = 0; i < slab_pages_; ++i)
+                pmm::free_frame(frames[i]);
+
+            LOG_WARN("[slab] %s: slab space exhausted\n", name_);
+            return nullptr;
+        }
+
+        vmm::map_frames(base, frames, slab_pages_, Present | Writable);
+
+        const uint32_t head = page_index(base);
+        for (uint32_t i = 0; i < slab_pages_; ++i)
+            slab_table[head + i].head = static_cast<uint16_t>(head);
+
+        Slab*          slab = &slab_table[head];
+        slab->cache = this;
+        slab->prev  = nullptr;
+        slab->next  = nullptr;
+        slab->inuse = 0;
+        slab->free  = nullptr;
+
+        // Thread the free list back to front so objects go out in address order.
+        for (uint32_t i = slab_objects_; i-- > 0;) {
+            void* object = reinterpret_cast<void*>(base + i * slot_);
+
+            if (ctor_)
+                ctor_(object);
+
+            next_free(object) = slab->free;
+            slab->free        = object;
+        }
+
+        return slab;
+    }
+
+    void SlabCache::release(Slab* slabs) {
+        if (!slabs)
+            return;
+
+        // One shootdown covers every released slab; the virtual ranges are
+        // only recycled once no core can still hold them in its TLB.
+        TlbBatch batch;
+        for (Slab* slab = slabs; slab; slab = slab->next) {
+            const uint32_t base = slab_base(slab);
+
+            if (dtor_) {
+                for (uint32_t i = 0; i < slab_objects_; ++i)
+                    dtor_(reinterpret_cast<void*>(base + i * slot_));
+            }
+
+            slab->cache = nullptr;
+            slab->free  = nullptr;
+            slab->prev  = nullptr;
+
+            vmm::unmap_pages(base, slab_pages_, batch);
+        }
+
+        vmm::commit(batch);
+
+        while (slabs) {
+            Slab* next = slabs->next;
+            slabs->next = nullptr;
+
+            {
+                kstd::InterruptSpinLockGuard guard(slab_space_lock);
+                slab_space.free_units(slab_base(slabs), slab_pages_);
+            }
+
+            slabs = next;
+        }
+    }
+}
@@ -4,35 +4,339 @@
 
 namespace mm {
     uint32_t vmm::kernel_dir_phys = 0;
+    bool     vmm::global_pages    = false;
+    bool     vmm::large_pages     = false;
+    bool     vmm::pat_enabled     = false;
 
     namespace {
         kstd::Atomic<uint32_t> tlb_shootdown_pending(0);
+
+        // Published under vmm::lock_ for the duration of one shootdown.
+        const TlbBatch*        tlb_shootdown_batch = nullptr;
+
+        struct LazyRegion {
+            uint32_t        base;
+            uint32_t        end;
+            uint32_t        flags;
+            vmm::LazyFilter filter;
+            void*           ctx;
+        };
+
+        kstd::SpinLock         lazy_lock;
+        LazyRegion             lazy_regions[vmm::MAX_LAZY_REGIONS];
+        uint32_t               lazy_count = 0;
+
+        bool find_lazy_region(uint32_t virt_addr, LazyRegion& out) {
+            kstd::InterruptSpinLockGuard guard(lazy_lock);
+
+            for (uint32_t i = 0; i < lazy_count; ++i) {
+                const LazyRegion& region = lazy_regions[i];
+                if (virt_addr >= region.base && virt_addr < region.end) {
+                    out = region;
+                    return true;
+                }
+            }
+
+            return false;
+        }
     }
 
-    void vmm::flush_remote_tlbs() {
-        smp::CoreManager* manager = smp::CoreManager::instance();
-        if (!manager)
+    namespace {
+        // Scratch slots in use per core; only ever touched by the core itself.
+        uint8_t kmap_depth[smp::CoreManager::MAX_CORES];
+
+        uint32_t kmap_core() {
+            if (smp::CoreManager::instance()) {
+                smp::Core* core = smp::CoreManager::current_anchor()->core;
+                if (core)
+                    return core->id;
+            }
+
+            return 0;
+        }
+
+        uint32_t kmap_slot(uint32_t core, uint32_t depth) {
+            return layout::virt::SCRATCH_BASE + (core * vmm::KMAP_SLOTS + depth) * PAGE_SIZE;
+        }
+    }
+
+    uint32_t vmm::kmap_local(uint32_t phys_addr) {
+        const uint32_t core  = kmap_core();
+        uint8_t&       depth = kmap_depth[core];
+
+        if (depth >= KMAP_SLOTS)
+            kstd::panic("kmap_local: core %u has no free slots\n", core);
+
+        const uint32_t virt_addr = kmap_slot(core, depth++);
+
+        Entry&         pte       = pte_entry(virt_addr);
+        pte.invalidate();
+        pte.set_address(align_address(phys_addr).aligned);
+        pte.update_flags(Present | Writable);
+
+        flush_tlb(virt_addr);
+        return virt_addr | (phys_addr & (PAGE_SIZE - 1));
+    }
+
+    void vmm::kunmap_local(uint32_t virt_addr) {
+        const uint32_t core  = kmap_core();
+        uint8_t&       depth = kmap_depth[core];
+
+        virt_addr = align_address(virt_addr).aligned;
+        if (!depth || virt_addr != kmap_slot(core, depth - 1))
+            kstd::panic("kunmap_local: 0x%08x is not the newest slot of core %u\n", virt_addr, core);
+
+        --depth;
+        pte_entry(virt_addr).invalidate();
+        flush_tlb(virt_addr);
+    }
+
+    uint32_t vmm::kmap_local_span(uint32_t phys_addr, uint32_t size) {
+        const AlignedResult aligned = align_address(phys_addr);
+        const uint32_t      pages   = align_up(aligned.offset + size, PAGE_SIZE) / PAGE_SIZE;
+
+        // Slots of one core are adjacent, so successive kmaps form one window.
+        const uint32_t      first   = kmap_local(phys_addr);
+        for (uint32_t i = 1; i < pages; ++i)
+            kmap_local(aligned.aligned + i * PAGE_SIZE);
+
+        return first;
+    }
+
+    void vmm::kunmap_local_span(uint32_t virt_addr, uint32_t size) {
+        const AlignedResult aligned = align_address(virt_addr);
+        const uint32_t      pages   = align_up(aligned.offset + size, PAGE_SIZE) / PAGE_SIZE;
+
+        for (uint32_t i = pages; i > 0; --i)
+            kunmap_local(aligned.aligned + (i - 1) * PAGE_SIZE);
+    }
+
+    bool vmm::map_alloc(uint32_t virt_addr, uint32_t pages, uint32_t flags, MemoryType type) {
+        virt_addr = align_address(virt_addr).aligned;
+
+        LockGuard guard;
+        for (uint32_t done = 0; done < pages;) {
+            uint32_t       count;
+            const uint32_t phys = pmm::alloc_frames_upto(pages - done, count);
+
+            if (!count) {
+                unmap_pages_locked(virt_addr, done, batch_);
+                commit_locked(batch_);
+                return false;
+            }
+
+            map_pages_locked(virt_addr + done * PAGE_SIZE, phys, count, flags, batch_, type);
+            done += count;
+        }
+
+        commit_locked(batch_);
+        return true;
+    }
+
+    bool vmm::reserve_lazy(uint32_t virt_addr, uint32_t size, uint32_t flags, LazyFilter filter, void* ctx) {
+        kstd::InterruptSpinLockGuard guard(lazy_lock);
+
+        if (lazy_count >= MAX_LAZY_REGIONS)
+            return false;
+
+        LazyRegion& region = lazy_regions[lazy_count++];
+        region.base   = align_address(virt_addr).aligned;
+        region.end    = virt_addr + size;
+        region.flags  = flags | Present;
+        region.filter = filter;
+        region.ctx    = ctx;
+        return true;
+    }
+
+    void vmm::release_lazy(uint32_t virt_addr) {
+        kstd::InterruptSpinLockGuard guard(lazy_lock);
+
+        for (uint32_t i = 0; i < lazy_count; ++i) {
+            if (lazy_regions[i].base != align_address(virt_addr).aligned)
+                continue;
+
+            lazy_regions[i] = lazy_regions[--lazy_count];
             return;
+        }
+    }
 
-        smp::Core* current_core = smp::CoreManager::current_anchor()->core;
-        if (!current_core)
+    /*
+        Backs the page under a not-present fault if it lies in a lazy region.
+        Another core may have faulted on the same page meanwhile; the PTE is
+        re-checked under the VMM lock and the spare frame handed back.
+    */
+    bool vmm::resolve_lazy_fault(uint32_t virt_addr) {
+        LazyRegion region;
+        if (!find_lazy_region(virt_addr, region))
+            return false;
+
+        if (region.filter && !region.filter(region.ctx, virt_addr))
+            return false;
+
+        const uint32_t page = align_address(virt_addr).aligned;
+        const uint32_t phys = pmm::alloc_zeroed_frame();
+        bool           raced;
+        {
+            LockGuard guard;
+
+            Entry&    pde = pde_entry(page);
+            raced = pde.has_flag(Present) && (pde.has_flag(HugePage) || pte_entry(page).has_flag(Present));
+
+            if (!raced) {
+                map_page_locked(page, phys, region.flags, batch_);
+                commit_locked(batch_);
+            }
+        }
+
+        if (raced)
+            pmm::free_frame(phys);
+
+        return true;
+    }
+
+    /*
+        Replaces the 4 MiB page covering `virt_addr` with a page table mapping
+        the same frames. The table is filled through the scratch slot before
+        the directory entry is swapped, so other cores never see a hole.
+    */
+    void vmm::split_large_page_locked(uint32_t virt_addr, TlbBatch& batch) {
+        Entry&         pde      = pde_entry(virt_addr);
+        const uint32_t previous = pde.value;
+        const uint32_t base     = previous & LARGE_PAGE_MASK;
+        const uint32_t flags    = (previous & Entry::FLAGS_MASK & ~(HugePage | Accessed | Dirty)) |
+                                  ((previous & LARGE_PAT) ? PAT : 0);
+
+        const uint32_t pt_phys  = pmm::alloc_frame();
+        if (!pt_phys)
+            kstd::panic("split_large_page: out of physical memory");
+
+        {
+            kstd::InterruptGuard guard;
+
+            Entry*               pt = reinterpret_cast<Entry*>(kmap_local(pt_phys));
+            for (uint32_t i = 0; i < LARGE_PAGE_FRAMES; ++i)
+                pt[i].value = (base + i * PAGE_SIZE) | flags;
+
+            kunmap_local(reinterpret_cast<uint32_t>(pt));
+        }
+
+        pde.invalidate();
+        pde.set_address(pt_phys);
+        pde.update_flags(Present | Writable | (flags & User));
+
+        // Both the 4 MiB translation and the recursive view of the old entry
+        // may be cached.
+        const uint32_t large_base = virt_addr & LARGE_PAGE_MASK;
+        flush_tlb(large_base);
+        flush_tlb(pt_virtual_base(virt_addr));
+        batch.queue(large_base, previous & Global);
+        batch.queue(pt_virtual_base(virt_addr), previous & Global);
+    }
+
+    void vmm::map_large_page_locked(uint32_t virt_addr, uint32_t phys_addr, uint32_t flags, TlbBatch& batch,
+                                    MemoryType type) {
+        Entry&         pde      = pde_entry(virt_addr);
+        const uint32_t previous = pde.value;
+
+        // A page table being replaced may still back live 4 KiB translations.
+        if ((previous & Present) && !(previous & HugePage)) {
+            for (uint32_t i = 0; i < LARGE_PAGE_FRAMES; ++i) {
+                const uint32_t virt = virt_addr + i * PAGE_SIZE;
+                const Entry&   pte  = pte_entry(virt);
+
+                if (!pte.has_flag(Present))
+                    continue;
+
+                flush_tlb(virt);
+                batch.queue(virt, pte.has_flag(Global));
+            }
+
+            defer_free_locked(previous & Entry::ADDRESS_MASK, 1, batch);
+        }
+
+        pde.invalidate();
+        pde.set_address(phys_addr);
+        pde.update_flags(flags | Present | HugePage | (global_pages ? Global : All));
+        pde.value |= cache_bits(type, true);
+
+        if (!(previous & Present) || previous == pde.value)
             return;
 
-        uint32_t pending = 0;
-        for (uint32_t i = 0; i < manager->core_count(); ++i) {
-            smp::Core& core = manager->core(i);
-            if (core.apic_id == current_core->apic_id)
-                continue;
-            if (!core.initialized.load(kstd::MemoryOrder::Acquire))
-                continue;
+        flush_tlb(virt_addr);
+        flush_tlb(pt_virtual_base(virt_addr));
+        batch.queue(virt_addr, previous & Global);
+        batch.queue(pt_virtual_base(virt_addr), previous & Global);
+    }
+
+    void vmm::unmap_large_page_locked(uint32_t virt_addr, TlbBatch& batch) {
+        Entry& pde = pde_entry(virt_addr);
+        if (!pde.has_flag(Present))
+            return;
 
-            ++pending;
+        if (!pde.has_flag(HugePage)) {
+            for (uint32_t i = 0; i < LARGE_PAGE_FRAMES; ++i)
+                unmap_page_locked(virt_addr + i * PAGE_SIZE, batch);
+
+            return;
         }
 
-        if (!pending)
+        const uint32_t previous = pde.value;
+
+        defer_free_locked(previous & LARGE_PAGE_MASK, LARGE_PAGE_FRAMES, batch);
+        pde.invalidate();
+
+        flush_tlb(virt_addr);
+        flush_tlb(pt_virtual_base(virt_addr));
+        batch.queue(virt_addr, previous & Global);
+        batch.queue(pt_virtual_base(virt_addr), previous & Global);
+    }
+
+    /*
+        Parked cores get a LazyFlush mark instead of an IPI. If the core woke
+        up first the exchange fails and the caller sends the IPI as usual, so
+        no core can run with stale entries after the shootdown returns.
+    */
+    static bool defer_flush(smp::Core& core) {
+        TlbState state = core.tlb_state.load(kstd::MemoryOrder::Acquire);
+
+        while (state != TlbState::Active) {
+            if (state == TlbState::LazyFlush)
+                return true;
+
+            if (core.tlb_state.compare_exchange_strong(state, TlbState::LazyFlush,
+                    kstd::MemoryOrder::AcqRel, kstd::MemoryOrder::Acquire))
+                return true;
+        }
+
+        return false;
+    }
+
+    void vmm::enter_lazy_tlb(smp::Core& core) {
+        core.tlb_state.store(TlbState::Lazy, kstd::MemoryOrder::Release);
+    }
+
+    void vmm::leave_lazy_tlb(smp::Core& core) {
+        if (core.tlb_state.load(kstd::MemoryOrder::Acquire) == TlbState::Active)
+            return;
+
+        // Nothing records what changed while the core was parked, so globals go too.
+        if (core.tlb_state.exchange(TlbState::Active, kstd::MemoryOrder::AcqRel) == TlbState::LazyFlush)
+            flush_global_tlb();
+    }
+
+    void vmm::flush_remote_tlbs(const TlbBatch& batch) {
+        if (!batch.count)
+            return;
+
+        smp::CoreManager* manager = smp::CoreManager::instance();
+        if (!manager)
             return;
 
-        tlb_shootdown_pending.store(pending, kstd::MemoryOrder::Release);
+        smp::Core* current_core = smp::CoreManager::current_anchor()->core;
+        if (!current_core)
+            return;
+
+        tlb_shootdown_batch = &batch;
 
         for (uint32_t i = 0; i < manager->core_count(); ++i) {
             smp::Core& core = manager->core(i);
@@ -40,16 +344,49 @@ namespace mm {
                 continue;
             if (!core.initialized.load(kstd::MemoryOrder::Acquire))
                 continue;
+            if (defer_flush(core))
+                continue;
 
+            tlb_shootdown_pending.fetch_add(1, kstd::MemoryOrder::AcqRel);
+            core.tlb_shootdown_owed.store(true, kstd::MemoryOrder::Release);
             current_core->lapic.send_ipi(core.apic_id, TLB_SHOOTDOWN_VECTOR);
         }
 
         while (tlb_shootdown_pending.load(kstd::MemoryOrder::Acquire) != 0)
             __pause;
+
+        tlb_shootdown_batch = nullptr;
     }
 
     void vmm::tlb_shootdown_handler(uint32_t, idt::BaseInterruptFrame*) {
-        flush_current_tlb();
+        answer_shootdown();
+    }
+
+    /*
+        A core spinning on lock_ may answer before its IPI is delivered, so
+        the IPI can find nothing owed. The owed flag is only ever set while
+        tlb_shootdown_batch is published.
+    */
+    void vmm::answer_shootdown() {
+        if (!smp::CoreManager::instance())
+            return;
+
+        smp::Core* core = smp::CoreManager::current_anchor()->core;
+        if (!core || !core->tlb_shootdown_owed.exchange(false, kstd::MemoryOrder::AcqRel))
+            return;
+
+        const TlbBatch* batch = tlb_shootdown_batch;
+
+        if (batch->full_flush()) {
+            if (batch->global)
+                flush_global_tlb();
+            else
+                flush_current_tlb();
+        } else {
+            for (uint32_t i = 0; i < batch->count; ++i)
+                flush_tlb(batch->pages[i]);
+        }
+
         tlb_shootdown_pending.fetch_sub(1, kstd::MemoryOrder::AcqRel);
     }
 }
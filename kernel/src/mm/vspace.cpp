@@ -0,0 +1,347 @@
+#include <mm/vspace.hpp>
+#include <mm/vmm.hpp>
+#include <klibcpp/object_cache.hpp>
+#include <klibcpp/kstd.hpp>
+#include <log.hpp>
+
+namespace mm {
+    struct VRange {
+        uint32_t base;
+        uint32_t pages;
+        uint32_t max_pages; // Largest `pages` in this subtree.
+        VRange*  left;
+        VRange*  right;
+        uint8_t  height;
+    };
+
+    namespace {
+        kstd::ObjectCache<VRange> range_nodes("vspace-range");
+
+        uint32_t end_of(const VRange* node) {
+            return node->base + node->pages * PAGE_SIZE;
+        }
+
+        uint8_t height(const VRange* node) {
+            return node ? node->height : 0;
+        }
+
+        uint32_t max_pages(const VRange* node) {
+            return node ? node->max_pages : 0;
+        }
+
+        void update(VRange* node) {
+            const uint8_t  lh = height(node->left);
+            const uint8_t  rh = height(node->right);
+            const uint32_t lm = max_pages(node->left);
+            const uint32_t rm = max_pages(node->right);
+
+            node->height    = static_cast<uint8_t>((lh > rh ? lh : rh) + 1);
+            node->max_pages = node->pages;
+
+            if (lm > node->max_pages)
+                node->max_pages = lm;
+            if (rm > node->max_pages)
+                node->max_pages = rm;
+        }
+
+        VRange* rotate_right(VRange* node) {
+            VRange* pivot = node->left;
+            node->left   = pivot->right;
+            pivot->right = node;
+
+            update(node);
+            update(pivot);
+            return pivot;
+        }
+
+        VRange* rotate_left(VRange* node) {
+            VRange* pivot = node->right;
+            node->right  = pivot->left;
+            pivot->left  = node;
+
+            update(node);
+            update(pivot);
+            return pivot;
+        }
+
+        VRange* balance(VRange* node) {
+            update(node);
+
+            const int factor = height(node->left) - height(node->right);
+
+            if (factor > 1) {
+                if (height(node->left->left) < height(node->left->right))
+                    node->left = rotate_left(node->left);
+
+                return rotate_right(node);
+            }
+
+            if (factor < -1) {
+                if (height(node->right->right) < height(node->right->left))
+                    node->right = rotate_right(node->right);
+
+                return rotate_left(node);
+            }
+
+            return node;
+        }
+
+        VRange* insert(VRange* root, VRange* node) {
+            if (!root) {
+                node->left      = nullptr;
+                node->right     = nullptr;
+                node->height    = 1;
+                node->max_pages = node->pages;
+                return node;
+            }
+
+            if (node->base < root->base)
+                root->left = insert(root->left, node);
+            else
+                root->right = insert(root->right, node);
+
+            return balance(root);
+        }
+
+        VRange* remove_min(VRange* root, VRange*& min) {
+            if (!root->left) {
+                min = root;
+                return root->right;
+            }
+
+            root->left = remove_min(root->left, min);
+            return balance(root);
+        }
+
+        VRange* remove(VRange* root, uint32_t base, VRange*& removed) {
+            if (!root)
+                return nullptr;
+
+            if (base < root->base) {
+                root->left = remove(root->left, base, removed);
+            } else if (base > root->base) {
+                root->right = remove(root->right, base, removed);
+            } else {
+                removed = root;
+
+                if (!root->right)
+                    return root->left;
+
+                VRange* next;
+                VRange* right = remove_min(root->right, next);
+                next->left  = root->left;
+                next->right = right;
+                return balance(next);
+            }
+
+            return balance(root);
+        }
+
+        // Re-derives max_pages along the path to `base` after a node shrank in place.
+        void refresh(VRange* root, uint32_t base) {
+            if (!root)
+                return;
+
+            if (base < root->base)
+                refresh(root->left, base);
+            else if (base > root->base)
+                refresh(root->right, base);
+
+            update(root);
+        }
+
+        // Lowest-addressed range of at least `pages` pages.
+        VRange* first_fit(VRange* node, uint32_t pages) {
+            while (node) {
+                if (max_pages(node->left) >= pages)
+                    node = node->left;
+                else if (node->pages >= pages)
+                    return node;
+                else
+                    node = node->right;
+            }
+
+            return nullptr;
+        }
+
+        // Range with the greatest base <= addr.
+        VRange* floor(VRange* node, uint32_t addr) {
+            VRange* best = nullptr;
+
+            while (node) {
+                if (node->base <= addr) {
+                    best = node;
+                    node = node->right;
+                } else {
+                    node = node->left;
+                }
+            }
+
+            return best;
+        }
+    }
+
+    uint32_t VirtualArena::alloc(uint32_t pages) {
+        if (!pages)
+            return 0;
+
+        const uint32_t need = pages + GUARD_PAGES;
+
+        // Nodes come from a slab, which may map pages, so they are taken
+        // before and returned after the arena lock.
+        VRange*        node  = range_nodes.create();
+        VRange*        seed  = seeded_ ? nullptr : range_nodes.create();
+        VRange*        spent = nullptr;
+        uint32_t       base  = 0;
+
+        if (!node)
+            return 0;
+
+        {
+            kstd::InterruptSpinLockGuard guard(lock_);
+
+            if (!seeded_ && seed) {
+                seed->base  = region_.base;
+                seed->pages = region_.size / PAGE_SIZE;
+                free_       = insert(free_, seed);
+                seeded_     = true;
+                seed        = nullptr;
+            }
+
+            VRange* fit = first_fit(free_, need);
+            if (fit) {
+                base = fit->base;
+
+                if (fit->pages == need) {
+                    free_ = remove(free_, base, spent);
+                } else {
+                    fit->base  += need * PAGE_SIZE;
+                    fit->pages -= need;
+                    refresh(free_, fit->base);
+                }
+
+                node->base   = base;
+                node->pages  = pages;
+                used_        = insert(used_, node);
+                node         = nullptr;
+                free_pages_ -= need;
+                ++allocations_;
+            }
+        }
+
+        range_nodes.destroy(node);
+        range_nodes.destroy(seed);
+        range_nodes.destroy(spent);
+
+        if (!base)
+            LOG_WARN("[vspace] %s: no room for %u pages\n", region_.name, pages);
+
+        return base;
+    }
+
+    uint32_t VirtualArena::free(uint32_t base) {
+        VRange*  merged[2] = {nullptr, nullptr};
+        uint32_t pages     = 0;
+
+        {
+            kstd::InterruptSpinLockGuard guard(lock_);
+
+            VRange*                      node = nullptr;
+            used_ = remove(used_, base, node);
+            if (!node)
+                return 0;
+
+            pages        = node->pages;
+            node->pages += GUARD_PAGES;
+            free_pages_ += node->pages;
+            --allocations_;
+
+            VRange* prev = floor(free_, base);
+            if (prev && end_of(prev) == base) {
+                free_        = remove(free_, prev->base, merged[0]);
+                node->base   = prev->base;
+                node->pages += prev->pages;
+            }
+
+            VRange* next = floor(free_, end_of(node));
+            if (next && next->base == end_of(node)) {
+                free_        = remove(free_, next->base, merged[1]);
+                node->pages += next->pages;
+            }
+
+            free_ = insert(free_, node);
+        }
+
+        range_nodes.destroy(merged[0]);
+        range_nodes.destroy(merged[1]);
+        return pages;
+    }
+
+    bool VirtualArena::lookup(uint32_t addr, uint32_t& base, uint32_t& pages) {
+        kstd::InterruptSpinLockGuard guard(lock_);
+
+        const VRange*                node = floor(used_, addr);
+        if (!node || addr >= end_of(node))
+            return false;
+
+        base  = node->base;
+        pages = node->pages;
+        return true;
+    }
+
+    namespace {
+        // Live allocations only, so guard pages and freed ranges still fault.
+        bool vmalloc_backs(void*, uint32_t addr) {
+            return vspace::arena<layout::virt::RegionId::VmallocSpace>().contains(addr);
+        }
+    }
+
+    void vspace::init() {
+        constexpr const auto& region = layout::virt::region<layout::virt::RegionId::VmallocSpace>();
+
+        if (!vmm::reserve_lazy(region.base, region.size, Present | Writable, vmalloc_backs))
+            kstd::panic("vspace: cannot reserve %s\n", region.name);
+    }
+
+    void* vmalloc(uint32_t size) {
+        if (!size)
+            return nullptr;
+
+        VirtualArena&  arena = vspace::arena<layout::virt::RegionId::VmallocSpace>();
+        const uint32_t pages = align_up(size, PAGE_SIZE) / PAGE_SIZE;
+        const uint32_t base  = arena.alloc(pages);
+        if (!base)
+            return nullptr;
+
+        if (!vmm::map_alloc(base, pages, Present | Writable)) {
+            arena.free(base);
+            return nullptr;
+        }
+
+        return reinterpret_cast<void*>(base);
+    }
+
+    void* vreserve(uint32_t size) {
+        if (!size)
+            return nullptr;
+
+        const uint32_t pages = align_up(size, PAGE_SIZE) / PAGE_SIZE;
+        return reinterpret_cast<void*>(vspace::arena<layout::virt::RegionId::VmallocSpace>().alloc(pages));
+    }
+
+    // Pages a vreserve() buffer never touched are skipped by unmap_pages().
+    void vfree(void* ptr) {
+        if (!ptr)
+            return;
+
+        VirtualArena&  arena = vspace::arena<layout::virt::RegionId::VmallocSpace>();
+        const uint32_t addr  = reinterpret_cast<uint32_t>(ptr);
+
+        uint32_t       base, pages;
+        if (!arena.lookup(addr, base, pages) || base != addr)
+            kstd::panic("vfree: 0x%08x was not returned by vmalloc\n", addr);
+
+        vmm::unmap_pages(base, pages);
+        arena.free(base);
+    }
+}
@@ -3,183 +3,500 @@
 #include <mm/vmm.hpp>
 #include <driver/pit.hpp>
 #include <klibcpp/kstd.hpp>
+#include <klibcpp/object_cache.hpp>
 #include <sys/smp.hpp>
 #include <log.hpp>
 
 namespace sched {
+    // Frames the idle task clears per pass, so a wakeup never waits long.
+    static constexpr uint32_t IDLE_PREZERO_BATCH = 4;
+
+    // Calibration window for the LAPIC timer.
+    static constexpr uint32_t TIMER_CALIBRATION_MS = 10;
+
+    static kstd::ObjectCache<smp::BaseCoreStack> task_stacks("task-stack");
+    static kstd::ObjectCache<Task>                task_cache("task");
+
+    // The stack a core booted on; its anchor names the core.
+    static smp::BaseCoreStack* boot_stack(smp::Core& core) {
+        return reinterpret_cast<smp::BaseCoreStack*>(core.stack.region_base);
+    }
+
+    template<uint8_t Vector>
+    static void reschedule(uint32_t, idt::BaseInterruptFrame* base_ctx) {
+        if (idt::get_isr_frame_kind<Vector>() != idt::InterruptFrameKind::ContextSwitch) {
+            LOG_WARN("[sched] received reschedule interrupt without extended context\n");
+            return;
+        }
+
+        smp::Core* current_core = smp::CoreManager::current_core();
+        if (current_core->has_scheduler())
+            current_core->scheduler().schedule(idt::InterruptFrame::from_base(base_ctx));
+    }
 
     static void dummy_func() {
         while (true)
             __hlt;
     }
 
-    Task::Task(uint32_t id, const char* name, smp::BaseCoreStack* task_stack)
-        : id(id), state(TaskState::READY), name(name) {
+    Task::Task(uint32_t id, const char* name, smp::BaseCoreStack* task_stack, smp::Core& core)
+        : id(id), state(TaskState::READY), name(name), priority(DEFAULT_PRIORITY),
+          ready_prev(nullptr), ready_next(nullptr), block_pending(false), wake_tick(0), handed_off(false) {
 
         if (task_stack) {
+            // Already running; the first reschedule saves its frame.
             stack     = task_stack;
-            stack_ptr = task_stack->initial_sp();
+            stack_ptr = 0;
             own_stack = false;
-            ctx.eax   = 0;
-            ctx.ebx   = 0;
-        } else {
-            stack     = new smp::BaseCoreStack;
-            stack_ptr = stack->initial_sp();
-            own_stack = true;
+            return;
+        }
 
-            uint32_t sp   = kstd::get_stack_pointer();
+        stack     = task_stacks.create();
+        own_stack = true;
 
-            auto*    test = smp::BaseCoreStack::from_sp(sp);
-            stack->copy_anchor_from(*test);
+        // The anchor must name the core the task runs on, not the one creating it.
+        stack->copy_anchor_from(*boot_stack(core));
 
-            ctx.base.eip = (uint32_t)&Task::_crt_task_entry;
-            ctx.eax      = (uint32_t)dummy_func;
-            ctx.ebx      = stack_ptr;
-        }
+        // The first switch to the task pops this frame off the top of its own stack.
+        stack_ptr = stack->initial_sp() - sizeof(idt::InterruptFrame);
 
-        ctx.ecx         = 0;
-        ctx.edx         = 0;
-        ctx.esi         = 0;
-        ctx.edi         = 0;
-        ctx.ebp         = 0;
-        ctx.esp         = 0;
+        idt::InterruptFrame& ctx = frame();
 
-        ctx.ds          = 0x10;
-        ctx.es          = 0x10;
-        ctx.fs          = 0x10;
-        ctx.gs          = 0x10;
+        ctx.eax           = (uint32_t)dummy_func;
+        ctx.ebx           = stack->initial_sp();
+        ctx.ecx           = 0;
+        ctx.edx           = 0;
+        ctx.esi           = 0;
+        ctx.edi           = 0;
+        ctx.ebp           = 0;
+        ctx.esp           = 0;
 
-        ctx.int_no      = 0;
-        ctx.err_code    = 0;
+        ctx.ds            = 0x10;
+        ctx.es            = 0x10;
+        ctx.fs            = 0x10;
+        ctx.gs            = 0x10;
 
-        ctx.base.cs     = 0x8;
-        ctx.base.eflags = 0x202;
+        ctx.int_no        = 0;
+        ctx.err_code      = 0;
 
+        ctx.base.eip      = (uint32_t)&Task::_crt_task_entry;
+        ctx.base.cs       = 0x8;
+        ctx.base.eflags   = 0x202;
+        ctx.base.user_esp = 0;
+        ctx.base.user_ss  = 0;
     }
 
     Task::~Task() {
         if (stack->base() && own_stack)
-            delete stack;
+            task_stacks.destroy(stack);
     }
 
-    Scheduler::Scheduler(uint32_t time_slice_ms)
-        : current_task_index(0), next_task_id(1),
-          initialized(false), time_slice_ms(time_slice_ms) {
-        kstd::InterruptGuard guard;
+    void Scheduler::install() {
+        idt::register_isr(YIELD_VECTOR, reschedule<YIELD_VECTOR>);
+        idt::register_isr(TICK_VECTOR, reschedule<TICK_VECTOR>);
 
-        if (initialized.load(kstd::MemoryOrder::Acquire))
-            return;
+        LAPIC& lapic = smp::CoreManager::current_core()->lapic;
 
-        this->time_slice_ms = time_slice_ms;
+        // Start on a PIT edge so the window is not short by a partial tick.
+        pit::sleep_ticks(1);
+        lapic.start_timer_probe(0xFFFFFFFF);
+        pit::sleep_us(TIMER_CALIBRATION_MS * 1000);
+        const uint32_t elapsed = 0xFFFFFFFF - lapic.timer_count();
+        lapic.stop_timer();
 
-        pit::register_handler(timer_tick, this, pit::TimerTrigger::Interval, time_slice_ms * 1000);
+        timer_ticks_per_ms = elapsed / TIMER_CALIBRATION_MS;
+        if (!timer_ticks_per_ms)
+            kstd::panic("sched: LAPIC timer did not count during calibration\n");
 
-        idt::register_isr(48, [](uint32_t, idt::BaseInterruptFrame* base_ctx) {
-                if (idt::get_isr_frame_kind<48>() == idt::InterruptFrameKind::ContextSwitch) {
-                    idt::InterruptFrame* ctx = idt::InterruptFrame::from_base(base_ctx);
-                    smp::Core* current_core  = smp::CoreManager::current_core();
-                    current_core->scheduler().schedule(ctx);
-                } else {
-                    LOG_WARN("[sched] received reschedule interrupt without extended context\n");
-                }
-            });
+        LOG_INFO("[sched] LAPIC timer runs at %u ticks/ms\n", timer_ticks_per_ms);
+    }
+
+    Scheduler::Scheduler(smp::Core& core, uint32_t time_slice_ms)
+        : core(core), current(nullptr), exiting(nullptr), dead(nullptr), ready{}, ready_mask(0), sleepers(nullptr),
+          initialized(false), time_slice_ms(time_slice_ms),
+          runnable(0), ticks_since_rebalance(0), balance{} {
+        kstd::InterruptGuard guard;
+
+        if (smp::CoreManager::current_core() != &core)
+            kstd::panic("sched: core %u scheduler constructed on another core\n", core.id);
 
-        create_task("idle", []() {
-                while (true)
-                    __pause;
-            });
+        if (!timer_ticks_per_ms)
+            kstd::panic("sched: Scheduler::install() has not run\n");
+
+        /*
+            The context that constructs the scheduler becomes the core's
+            "kernel" task. Its frame is captured by the first reschedule.
+        */
+        Task* boot = task_cache.create(next_task_id.fetch_add(1, kstd::MemoryOrder::Relaxed), "kernel", boot_stack(core), core);
+        if (!boot)
+            kstd::panic("sched: core %u could not allocate its boot task\n", core.id);
+
+        boot->state = TaskState::RUNNING;
+        current     = boot;
+
+        // APs already idle in their boot context (CoreManager::_pause()).
+        if (core.is_bsp) {
+            runnable.store(1, kstd::MemoryOrder::Relaxed);
+
+            create_task("idle", []() {
+                    while (true) {
+                        if (!mm::pmm::prezero_frames(IDLE_PREZERO_BATCH))
+                            __pause;
+                    }
+                }, IDLE_PRIORITY);
+        } else {
+            boot->priority = IDLE_PRIORITY;
+        }
 
         initialized.store(true, kstd::MemoryOrder::Release);
+        core.lapic.start_timer(TICK_VECTOR, time_slice_ms * timer_ticks_per_ms);
 
-        LOG_INFO("[sched] Initialized with %ums time slice\n", time_slice_ms);
+        LOG_INFO("[sched] Core %u initialized with %ums time slice\n", core.id, time_slice_ms);
     }
 
     Scheduler::~Scheduler() {
+        stop();
+    }
+
+    void Scheduler::stop() {
         kstd::InterruptGuard guard;
 
         initialized.store(false, kstd::MemoryOrder::Release);
 
-        pit::unregister_handler(timer_tick, this);
-        idt::unregister_isr(48);
+        // A core can only silence its own timer; other cores stop switching on their next tick.
+        if (smp::CoreManager::current_core() == &core)
+            core.lapic.stop_timer();
     }
 
-    void Scheduler::timer_tick(idt::InterruptFrame* ctx, void* ptr) {
-        Scheduler* c = reinterpret_cast<Scheduler*>(ptr);
-        c->schedule(ctx);
+    Task& Scheduler::spawn(const char* name, void (*entry_point)(), uint8_t priority) {
+        smp::CoreManager* cores = smp::CoreManager::instance();
+        const uint32_t    count = cores->core_count();
+        const uint32_t    first = next_core.fetch_add(1, kstd::MemoryOrder::Relaxed) % count;
+
+        Scheduler*        best      = nullptr;
+        uint32_t          best_load = 0;
+
+        for (uint32_t i = 0; i < count; i++) {
+            smp::Core& candidate = cores->core((first + i) % count);
+            if (!candidate.has_scheduler() || !candidate.scheduler().is_initialized())
+                continue;
+
+            const uint32_t load = candidate.scheduler().load();
+            if (!best || load < best_load) {
+                best      = &candidate.scheduler();
+                best_load = load;
+            }
+        }
+
+        if (!best)
+            kstd::panic("sched: no core is running a scheduler\n");
+
+        return best->create_task(name, entry_point, priority);
+    }
+
+    void Scheduler::balance_stats(BalanceStats& out) {
+        kstd::InterruptSpinLockGuard guard(lock);
+        out = balance;
     }
 
-    Task& Scheduler::create_task(const char* name, void (*entry_point)()) {
+    Task& Scheduler::create_task(const char* name, void (*entry_point)(), uint8_t priority) {
+        if (priority >= PRIORITY_LEVELS)
+            kstd::panic("sched: task %s has priority %u, limit is %u\n", name, priority, PRIORITY_LEVELS - 1);
+
+        reap();
+
         kstd::InterruptSpinLockGuard guard(lock);
-        Task& task = tasks.emplace(next_task_id++, name, nullptr);
+        Task* created = task_cache.create(next_task_id.fetch_add(1, kstd::MemoryOrder::Relaxed), name, nullptr, core);
+        if (!created)
+            kstd::panic("sched: out of memory creating task %s\n", name);
 
-        task.ctx.eax = (uint32_t)entry_point;
+        Task& task = *created;
 
+        task.frame().eax = (uint32_t)entry_point;
+        task.priority    = priority;
+
+        if (!task.is_idle())
+            runnable.fetch_add(1, kstd::MemoryOrder::Relaxed);
+
+        enqueue(task);
         return task;
     }
 
-    void Scheduler::schedule(idt::InterruptFrame* ctx) {
-        kstd::InterruptSpinLockGuard guard(lock);
+    // Frees terminated tasks outside the lock and with interrupts on, since releasing slabs may shoot down TLBs.
+    void Scheduler::reap() {
+        Task* list;
+        {
+            kstd::InterruptSpinLockGuard guard(lock);
+            list = dead;
+            dead = nullptr;
+        }
+
+        while (list) {
+            Task* next = list->ready_next;
+            task_cache.destroy(list);
+            list = next;
+        }
+    }
+
+    void Scheduler::enqueue(Task& task) {
+        ReadyList& list = ready[task.priority];
+
+        task.ready_prev = list.tail;
+        task.ready_next = nullptr;
+
+        if (list.tail)
+            list.tail->ready_next = &task;
+        else
+            list.head = &task;
+
+        list.tail   = &task;
+        ready_mask |= 1u << task.priority;
+    }
+
+    void Scheduler::unlink(Task& task) {
+        ReadyList& list = ready[task.priority];
+
+        if (task.ready_prev)
+            task.ready_prev->ready_next = task.ready_next;
+        else
+            list.head = task.ready_next;
+
+        if (task.ready_next)
+            task.ready_next->ready_prev = task.ready_prev;
+        else
+            list.tail = task.ready_prev;
+
+        task.ready_prev = nullptr;
+        task.ready_next = nullptr;
+
+        if (!list.head)
+            ready_mask &= ~(1u << task.priority);
+    }
+
+    void Scheduler::make_ready(Task& task) {
+        task.state = TaskState::READY;
+
+        if (!task.is_idle())
+            runnable.fetch_add(1, kstd::MemoryOrder::Relaxed);
+
+        enqueue(task);
+    }
 
-        if (!initialized.load(kstd::MemoryOrder::Acquire) || tasks.empty())
+    // Takes the just-saved current task off the CPU until it is woken.
+    void Scheduler::park(Task& task) {
+        task.block_pending = false;
+        task.state         = TaskState::BLOCKED;
+
+        if (!task.is_idle())
+            runnable.fetch_sub(1, kstd::MemoryOrder::Relaxed);
+
+        if (!task.wake_tick)
             return;
 
+        Task** link = &sleepers;
+        while (*link && (*link)->wake_tick <= task.wake_tick)
+            link = &(*link)->ready_next;
+
+        task.ready_next = *link;
+        *link           = &task;
+    }
+
+    void Scheduler::wake_sleepers() {
+        const uint64_t now = pit::ticks();
+
+        while (sleepers && sleepers->wake_tick <= now) {
+            Task* task = sleepers;
+            sleepers = task->ready_next;
+
+            task->ready_next = nullptr;
+            task->wake_tick  = 0;
+            make_ready(*task);
+        }
+    }
+
+    Task& Scheduler::prepare_block(uint64_t wake_tick) {
+        kstd::InterruptSpinLockGuard guard(lock);
+
+        if (!current || current->is_idle())
+            kstd::panic("sched: core %u idle context cannot block\n", core.id);
+
+        current->block_pending = true;
+        current->wake_tick     = wake_tick;
+        return *current;
+    }
+
+    void Scheduler::wake(Task& task) {
+        // Only READY tasks migrate, so the anchor is stable for a blocked or blocking task.
+        Scheduler&                   owner = task.stack->anchor.core->scheduler();
+        kstd::InterruptSpinLockGuard guard(owner.lock);
+
+        if (task.state == TaskState::BLOCKED)
+            owner.make_ready(task);
+        else
+            task.block_pending = false;
+    }
+
+    Task* Scheduler::pick_next() {
+        if (!ready_mask)
+            return nullptr;
+
+        Task* task = ready[31u - static_cast<uint32_t>(__builtin_clz(ready_mask))].head;
+        unlink(*task);
+        return task;
+    }
+
+    // Called with `lock` held and interrupts off.
+    bool Scheduler::steal(bool rebalance) {
+        smp::CoreManager* cores       = smp::CoreManager::instance();
+        Scheduler*        victim      = nullptr;
+        uint32_t          victim_load = 0;
+
+        for (uint32_t i = 0; i < cores->core_count(); i++) {
+            smp::Core& peer = cores->core(i);
+            if (&peer == &core || !peer.has_scheduler() || !peer.scheduler().is_initialized())
+                continue;
+
+            const uint32_t peer_load = peer.scheduler().load();
+            if (peer_load > victim_load) {
+                victim      = &peer.scheduler();
+                victim_load = peer_load;
+            }
+        }
+
         /*
-            By design there are always two tasks: "idle" and "kernel".
-            If only one task exists at this point, it means init() has just run
-            and we still need to create the "kernel" task, because `ctx` currently
-            contains the BSP kernel context.
+            An idle core only takes work a peer has queued behind the task it
+            is running; a rebalance only moves work when that narrows the gap.
         */
-        if (tasks.live_count() <= 1) {
-            Task& task = tasks.emplace(next_task_id++, "kernel", &stack);
-
-            memcpy((uint8_t*)&task.ctx, (uint8_t*)ctx, sizeof(idt::InterruptFrame));
-
-            current_task_index = 1;
-        } else if (tasks.occupied(current_task_index)) {
-            Task& current = tasks[current_task_index];
-            if (current.state == TaskState::RUNNING) {
-                current.stack_ptr = (uint32_t)ctx + sizeof(idt::InterruptFrame);
-                memcpy((uint8_t*)&current.ctx, (uint8_t*)ctx, sizeof(idt::InterruptFrame));
-
-                if (ctx->eax == 0xDEADDEAD && ctx->ebp == 0x00000000) {
-                    current.state = TaskState::TERMINATED;
-                    LOG_INFO("[sched] Task %u (%s) terminated\n", current.id, current.name);
-                } else {
-                    current.state = TaskState::READY;
+        const uint32_t threshold = rebalance ? load() + 2 : 2;
+        if (!victim || victim_load < threshold)
+            return false;
+
+        if (!victim->lock.try_lock()) {
+            ++balance.contended;
+            return false;
+        }
+
+        // Highest priority first; tasks on their core's boot stack stay put.
+        Task* task = nullptr;
+        for (uint32_t mask = victim->ready_mask & ~(1u << IDLE_PRIORITY); mask && !task;) {
+            const uint32_t level = 31u - static_cast<uint32_t>(__builtin_clz(mask));
+            mask &= ~(1u << level);
+
+            for (Task* it = victim->ready[level].head; it; it = it->ready_next) {
+                if (it->own_stack) {
+                    task = it;
+                    break;
                 }
             }
         }
 
-        size_t start_index = current_task_index;
-        do {
-            current_task_index = (current_task_index + 1) % tasks.capacity();
+        const bool moved = task != nullptr;
+        if (moved) {
+            // The task and its saved frame move as they are; only the links and the anchor change.
+            victim->unlink(*task);
+            task->stack->anchor.core = &core;
+            enqueue(*task);
 
-            if (!tasks.occupied(current_task_index))
-                continue;
+            victim->runnable.fetch_sub(1, kstd::MemoryOrder::Relaxed);
+            runnable.fetch_add(1, kstd::MemoryOrder::Relaxed);
+            ++victim->balance.stolen;
+        }
+
+        victim->lock.unlock();
+
+        if (moved)
+            ++(rebalance ? balance.rebalance_steals : balance.idle_steals);
+
+        return moved;
+    }
+
+    void Scheduler::schedule(idt::InterruptFrame* ctx) {
+        kstd::InterruptSpinLockGuard guard(lock);
+
+        if (!initialized.load(kstd::MemoryOrder::Acquire) || !current)
+            return;
 
-            Task& next = tasks[current_task_index];
-            if (next.state == TaskState::READY) {
-                next.state = TaskState::RUNNING;
-                memcpy((uint8_t*)ctx, (uint8_t*)&next.ctx, sizeof(idt::InterruptFrame));
-                return;
+        // The previous pass switched off this task's stack for good.
+        if (exiting) {
+            exiting->ready_next = dead;
+            dead                = exiting;
+            exiting             = nullptr;
+        }
+
+        if (current->state == TaskState::RUNNING) {
+            // The frame stays where the stub pushed it, on the task's own stack.
+            current->stack_ptr = (uint32_t)ctx;
+
+            if (ctx->eax == 0xDEADDEAD && ctx->ebp == 0x00000000) {
+                current->state = TaskState::TERMINATED;
+                if (!current->is_idle())
+                    runnable.fetch_sub(1, kstd::MemoryOrder::Relaxed);
+                LOG_INFO("[sched] Task %u (%s) terminated\n", current->id, current->name);
+            } else if (current->block_pending) {
+                park(*current);
+            } else {
+                current->state = TaskState::READY;
+                enqueue(*current);
             }
+        }
 
-        } while (current_task_index != start_index);
+        wake_sleepers();
 
-        if (tasks.occupied(current_task_index)) {
-            Task& current = tasks[current_task_index];
-            current.state = TaskState::RUNNING;
+        if (ctx->int_no == TICK_VECTOR && ++ticks_since_rebalance >= REBALANCE_TICKS) {
+            ticks_since_rebalance = 0;
+            ++balance.rebalance_passes;
+            steal(true);
         }
+
+        // Only idle-class work left here: look for a peer's queued work first.
+        if (!(ready_mask & ~(1u << IDLE_PRIORITY)))
+            steal(false);
+
+        Task* next = pick_next();
+        if (!next)
+            return;
+
+        if (current->state == TaskState::TERMINATED)
+            exiting = current;
+
+        current        = next;
+        current->state = TaskState::RUNNING;
+
+        // The stub resumes from the next task's stack instead of `ctx`.
+        if (&current->frame() != ctx)
+            core.switch_frame = &current->frame();
     }
 
     void Scheduler::yield() {
         if (!initialized.load(kstd::MemoryOrder::Acquire))
             return;
 
-        kstd::trigger_interrupt<48>();
+        kstd::trigger_interrupt<YIELD_VECTOR>();
+    }
+
+    bool can_block() {
+        smp::Core* core = smp::CoreManager::current_anchor()->core;
+
+        return core && core->has_scheduler() && core->scheduler().is_initialized()
+               && !core->scheduler().current_task().is_idle();
+    }
+
+    void sleep_for(uint32_t us) {
+        if (!can_block()) {
+            pit::sleep_us(us);
+            return;
+        }
+
+        uint32_t ticks = us / pit::interval();
+        ticks = ticks == 0 ? 1 : ticks;
+
+        kstd::InterruptGuard guard;
+        Scheduler&           scheduler = smp::CoreManager::current_core()->scheduler();
+        scheduler.prepare_block(pit::ticks() + ticks);
+        scheduler.yield();
     }
 
     Task& Scheduler::current_task() {
-        return tasks[current_task_index];
+        return *current;
     }
 }
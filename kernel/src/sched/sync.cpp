@@ -0,0 +1,121 @@
+#include <sched/sync.hpp>
+#include <klibcpp/kstd.hpp>
+
+namespace sched {
+    // Contexts with no task to name own locks as their core, above the task id range.
+    static constexpr uint32_t CORE_OWNER = 0x80000000;
+
+    static uint32_t owner_id() {
+        smp::Core* core = smp::CoreManager::current_anchor()->core;
+
+        if (can_block())
+            return core->scheduler().current_task().id;
+
+        return CORE_OWNER | (core ? core->id : 0xFF);
+    }
+
+    bool Mutex::try_acquire(uint32_t owner) {
+        uint32_t expected = 0;
+        return owner_.compare_exchange_strong(expected, owner,
+            kstd::MemoryOrder::Acquire, kstd::MemoryOrder::Relaxed);
+    }
+
+    bool Mutex::try_lock() {
+        return try_acquire(owner_id());
+    }
+
+    void Mutex::lock() {
+        const uint32_t me = owner_id();
+
+        if (owner_.load(kstd::MemoryOrder::Relaxed) == me)
+            kstd::panic("sched: mutex relocked by its owner 0x%08x\n", me);
+
+        for (uint32_t spin = 0; spin < SYNC_SPIN_LIMIT; spin++) {
+            if (try_acquire(me))
+                return;
+
+            __pause;
+        }
+
+        if (!can_block()) {
+            while (!try_acquire(me))
+                __pause;
+
+            return;
+        }
+
+        waiters_.wait_handoff([&]() {
+                return try_acquire(me);
+            });
+
+        // A handoff leaves HANDOFF_PENDING for the new holder to claim.
+        owner_.store(me, kstd::MemoryOrder::Relaxed);
+    }
+
+    void Mutex::unlock() {
+        const uint32_t me = owner_id();
+
+        if (owner_.load(kstd::MemoryOrder::Relaxed) != me)
+            kstd::panic("sched: mutex released by 0x%08x, held by 0x%08x\n", me, owner_.load());
+
+        owner_.store(HANDOFF_PENDING, kstd::MemoryOrder::Release);
+        waiters_.hand_off([&]() {
+                owner_.store(0, kstd::MemoryOrder::Release);
+            });
+    }
+
+    bool Semaphore::try_acquire() {
+        uint32_t count = count_.load(kstd::MemoryOrder::Relaxed);
+
+        while (count) {
+            if (count_.compare_exchange_strong(count, count - 1,
+                kstd::MemoryOrder::Acquire, kstd::MemoryOrder::Relaxed))
+                return true;
+        }
+
+        return false;
+    }
+
+    void Semaphore::acquire() {
+        for (uint32_t spin = 0; spin < SYNC_SPIN_LIMIT; spin++) {
+            if (try_acquire())
+                return;
+
+            __pause;
+        }
+
+        if (!can_block()) {
+            while (!try_acquire())
+                __pause;
+
+            return;
+        }
+
+        // A handoff passes the released unit without it touching count_.
+        waiters_.wait_handoff([&]() {
+                return try_acquire();
+            });
+    }
+
+    void Semaphore::release() {
+        waiters_.hand_off([&]() {
+                count_.fetch_add(1, kstd::MemoryOrder::Release);
+            });
+    }
+
+    void CondVar::wait(Mutex& mutex) {
+        waiters_.wait_releasing([&]() {
+                mutex.unlock();
+            });
+
+        mutex.lock();
+    }
+
+    void CondVar::notify_one() {
+        waiters_.wake_one();
+    }
+
+    void CondVar::notify_all() {
+        waiters_.wake_all();
+    }
+}
@@ -0,0 +1,94 @@
+#include <sched/wait_queue.hpp>
+
+namespace sched {
+    void WaitQueue::park_current() {
+        Task& task = smp::CoreManager::current_core()->scheduler().prepare_block();
+
+        task.ready_prev = tail_;
+        task.ready_next = nullptr;
+
+        if (tail_)
+            tail_->ready_next = &task;
+        else
+            head_ = &task;
+
+        tail_ = &task;
+    }
+
+    Task* WaitQueue::pop_locked() {
+        Task* task = head_;
+        if (!task)
+            return nullptr;
+
+        head_ = task->ready_next;
+        if (head_)
+            head_->ready_prev = nullptr;
+        else
+            tail_ = nullptr;
+
+        task->ready_prev = nullptr;
+        task->ready_next = nullptr;
+        return task;
+    }
+
+    bool WaitQueue::take_handoff() {
+        Task& task = smp::CoreManager::current_core()->scheduler().current_task();
+        if (!task.handed_off)
+            return false;
+
+        task.handed_off = false;
+        return true;
+    }
+
+    void WaitQueue::wait() {
+        kstd::InterruptGuard guard;
+
+        {
+            kstd::SpinLockGuard lock(lock_);
+            park_current();
+        }
+
+        smp::CoreManager::current_core()->scheduler().yield();
+    }
+
+    bool WaitQueue::wake_one() {
+        Task* task;
+
+        {
+            kstd::InterruptSpinLockGuard guard(lock_);
+
+            task = pop_locked();
+            if (!task)
+                return false;
+        }
+
+        Scheduler::wake(*task);
+        return true;
+    }
+
+    uint32_t WaitQueue::wake_all() {
+        Task* task;
+
+        {
+            kstd::InterruptSpinLockGuard guard(lock_);
+
+            task  = head_;
+            head_ = nullptr;
+            tail_ = nullptr;
+        }
+
+        uint32_t woken = 0;
+        while (task) {
+            Task* next = task->ready_next;
+
+            task->ready_prev = nullptr;
+            task->ready_next = nullptr;
+            Scheduler::wake(*task);
+
+            task = next;
+            ++woken;
+        }
+
+        return woken;
+    }
+}
@@ -64,10 +64,43 @@ namespace {
 
         return true;
     }
+
+    static bool page_has_file_data(const Linker::Region* reg, uint32_t page) {
+        const uint32_t lo = page * mm::PAGE_SIZE;
+        const uint32_t hi = lo + mm::PAGE_SIZE;
+
+        for (const Linker::Section* sec = reg->section; sec; sec = sec->next) {
+            if (sec->kind != Linker::SecKind::PROGBITS)
+                continue;
+
+            if (sec->reg_off < hi && sec->reg_off + sec->size > lo)
+                return true;
+        }
+
+        return false;
+    }
+
+    // Only pages shared with PROGBITS data need clearing; stage1 already
+    // cleared every other page of the region.
+    static void zero_section(const Linker::Region* reg, const Linker::Section* sec) {
+        const uint32_t end = sec->reg_off + sec->size;
+
+        for (uint32_t off = sec->reg_off; off < end; ) {
+            const uint32_t page = off / mm::PAGE_SIZE;
+            uint32_t       next = (page + 1) * mm::PAGE_SIZE;
+            if (next > end)
+                next = end;
+
+            if (page_has_file_data(reg, page))
+                memset(reinterpret_cast<uint8_t*>(reg->base + off), 0, next - off);
+
+            off = next;
+        }
+    }
 }
 
 Linker::Layout* Linker::load(Object* obj) {
-    kstd::InterruptSpinLockGuard guard(lock_);
+    sched::MutexGuard guard(lock_);
 
     if (!obj) {
         LOG_ERR("[linker] load: null object\n");
@@ -97,7 +130,7 @@ _Lerror:
 }
 
 Linker::~Linker() {
-    kstd::InterruptSpinLockGuard guard(lock_);
+    sched::MutexGuard guard(lock_);
 
     while (!layouts.empty()) {
         for (size_t i = 0; i < layouts.capacity(); ++i) {
@@ -112,7 +145,7 @@ Linker::~Linker() {
 }
 
 void Linker::unload(Layout* layout) {
-    kstd::InterruptSpinLockGuard guard(lock_);
+    sched::MutexGuard guard(lock_);
     unload_locked(layout);
 }
 
@@ -139,7 +172,7 @@ bool Linker::stage0(Layout* layout, Object* obj) {
         if (sec->type == SHT_NULL || sec->size == 0)
             continue;
 
-        Section* new_sec = new Section();
+        Section* new_sec = sections.create();
         new_sec->kind = (sec->type == SHT_PROGBITS) ? SecKind::PROGBITS :
             (sec->type == SHT_NOBITS)   ? SecKind::NOBITS   :
             SecKind::UNKNOWN;
@@ -160,7 +193,7 @@ bool Linker::stage0(Layout* layout, Object* obj) {
         if (!access_is_loadable(new_sec->access)) {
             LOG_WARN("[linker] stage0: dropping non-loadable alloc section idx=%u access=%s\n",
                 i, access_name(new_sec->access));
-            delete new_sec;
+            sections.destroy(new_sec);
             continue;
         }
 
@@ -181,7 +214,7 @@ bool Linker::stage0(Layout* layout, Object* obj) {
             default: {
                 LOG_WARN("[linker] stage0: unexpected access class idx=%u access=%s\n",
                     i, access_name(new_sec->access));
-                delete new_sec;
+                sections.destroy(new_sec);
                 continue;
             }
         }
@@ -206,18 +239,25 @@ bool Linker::stage1(Region* reg, Object* obj) {
 
     const uint32_t pages = reg->size / mm::PAGE_SIZE;
 
-    reg->base = mem_mngr.alloc_units(pages);
+    mm::VirtualArena& space = mm::vspace::arena<mm::layout::virt::RegionId::ModuleSpace>();
 
-    uint32_t phys = mm::pmm::alloc_frames(pages);
+    reg->base = space.alloc(pages);
+    if (!reg->base) {
+        LOG_WARN("[linker] stage1: out of module space for %u pages\n", pages);
+        return false;
+    }
 
-    if (!phys) {
-        mem_mngr.free_units(reg->base, pages);
+    if (!mm::vmm::map_alloc(reg->base, pages, mm::Flags::Present | mm::Flags::Writable)) {
+        space.free(reg->base);
         reg->base = 0;
         LOG_WARN("[linker] stage1: out of physical memory\n");
         return false;
     }
 
-    mm::vmm::map_pages(reg->base, phys, pages, mm::Flags::Present | mm::Flags::Writable);
+    for (uint32_t i = 0; i < pages; ++i) {
+        if (!page_has_file_data(reg, i))
+            memset(reinterpret_cast<uint8_t*>(reg->base + i * mm::PAGE_SIZE), 0, mm::PAGE_SIZE);
+    }
 
     for (Section* sec = reg->section; sec; sec = sec->next) {
         if (!validate_region_section_bounds(reg, sec)) {
@@ -237,25 +277,25 @@ bool Linker::stage1(Region* reg, Object* obj) {
             }
             memcpy(dst, src, sec->size);
         } else if (sec->kind == SecKind::NOBITS) {
-            memset(dst, 0, sec->size);
+            zero_section(reg, sec);
         } else {
             LOG_WARN("[linker] stage1: unknown section kind, zeroing region=%u off=0x%08x size=0x%08x\n",
                 reg->index, sec->reg_off, sec->size);
-            memset(dst, 0, sec->size);
+            zero_section(reg, sec);
         }
     }
 
     return true;
 }
 
-void Linker::unload_region_locked(Region& reg) {
+void Linker::unload_region_locked(Region& reg, mm::TlbBatch& batch) {
     if (!reg.base || !reg.size)
         return;
 
     const uint32_t pages = reg.size / mm::PAGE_SIZE;
 
-    mm::vmm::unmap_pages(reg.base, pages);
-    mem_mngr.free_units(reg.base, pages);
+    mm::vmm::unmap_pages(reg.base, pages, batch);
+    mm::vspace::arena<mm::layout::virt::RegionId::ModuleSpace>().free(reg.base);
 
     reg.base = 0;
 }
@@ -264,8 +304,12 @@ void Linker::unload_locked(Layout* layout) {
     if (!layout)
         return;
 
-    unload_region_locked(layout->rw);
-    unload_region_locked(layout->rx);
+    // Both regions go out with a single shootdown, before lock_ lets anyone
+    // reuse the virtual ranges.
+    mm::TlbBatch batch;
+    unload_region_locked(layout->rw, batch);
+    unload_region_locked(layout->rx, batch);
+    mm::vmm::commit(batch);
 
     const size_t index = layouts.index_of(layout);
     if (index == kstd::StaticArray<Layout, 64>::npos) {
@@ -2,6 +2,7 @@
 #include <kernel.hpp>
 #include <mm/vmm.hpp>
 #include <int/idt.hpp>
+#include <sched/scheduler.hpp>
 
 namespace smp {
     Kernel& Core::kernel() {
@@ -12,10 +13,25 @@ namespace smp {
     }
 
     sched::Scheduler& Core::scheduler() {
-        auto* scheduler = &kernel()._sched.get();
-        if (!scheduler)
+        if (!scheduler_)
             kstd::panic("core scheduler is not constructed");
 
-        return *scheduler;
+        return *scheduler_;
+    }
+
+    void Core::start_scheduler() {
+        if (scheduler_)
+            kstd::panic("core %u scheduler is already running", id);
+
+        scheduler_ = new sched::Scheduler(*this);
+    }
+
+    void CoreManager::stop_schedulers() {
+        for (uint32_t i = 0; i < core_count_; i++) {
+            Core& core_ref = core(i);
+
+            if (core_ref.has_scheduler())
+                core_ref.scheduler().stop();
+        }
     }
 }
@@ -9,6 +9,7 @@ void warm_start_32() {
         They equal to BSP's GDT, IDT and Paging
     */
     kstd::init_fpu();
+    mm::vmm::load_pat();
     kstd::atomic_thread_fence(kstd::MemoryOrder::Acquire);
     smp::Core* core = smp::CoreManager::current_core();
     core->lapic.enable();
@@ -16,7 +17,8 @@ void warm_start_32() {
     LOG_INFO("[smp] Core %u is ready\n", core->id);
 
     core->initialized.store(true, kstd::MemoryOrder::Release);
-    smp::CoreManager::_pause(); // Go to sleep
+    core->start_scheduler();
+    smp::CoreManager::_pause(); // Idle until the scheduler hands us a task
 }
 
 __extern_c
@@ -47,6 +49,9 @@ void warm_start_16() {
 
          "lidt smp_idt_ptr\n"
 
+         "movl smp_cr4, %%eax\n"
+         "movl %%eax, %%cr4\n"
+
          "movl smp_pd_phy_addr, %%eax\n"
          "movl %%eax, %%cr3\n"
 
@@ -66,6 +71,7 @@ void warm_start_16() {
          ".global smp_gdt_ptr\n"
          ".global smp_idt_ptr\n"
          ".global smp_pd_phy_addr\n"
+         ".global smp_cr4\n"
          ".global smp_stack_top\n"
 
          "smp_gdt_ptr:\n"
@@ -77,6 +83,9 @@ void warm_start_16() {
          "smp_pd_phy_addr:\n"
          ".space 4\n"
 
+         "smp_cr4:\n"
+         ".space 4\n"
+
          "smp_stack_top:\n"
          ".space 4\n"
 
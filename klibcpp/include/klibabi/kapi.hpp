@@ -5,7 +5,7 @@
 
 __extern_c {
     struct KernelAPI {
-        __cdecl void*    (*kmalloc)(uint32_t, bool);
+        __cdecl void*    (*kmalloc)(uint32_t, uint32_t);
         __cdecl void     (*kfree)(void*);
 
         __cdecl uint32_t (*get_ticks)();
@@ -18,6 +18,9 @@ __extern_c {
         */
         __cdecl void     (*putc)(char);
         __cdecl char     (*getc)();
+
+        // Appended so modules built against the older layout keep their offsets.
+        __cdecl void*    (*krealloc)(void*, uint32_t);
     } __packed;
 }
 
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <klibcpp/cstdint.hpp>
+
+// Chunk-size histogram buckets: bucket i counts chunks of [16 << i, 32 << i) bytes.
+inline constexpr uint32_t HEAP_STATS_SIZE_CLASSES = 16;
+
+__extern_c {
+    struct HeapStats {
+        uint32_t heap_size;
+        uint32_t heap_max;
+
+        // Bytes in chunks owned by callers; chunks parked in per-core caches are in cached_bytes.
+        uint32_t in_use_bytes;
+        uint32_t cached_bytes;
+        // High-water mark of in_use_bytes + cached_bytes, i.e. of what the bins had to supply.
+        uint32_t peak_bytes;
+
+        uint32_t free_bytes;
+        uint32_t free_chunks;
+        uint32_t largest_free_chunk;
+
+        uint32_t allocs;
+        uint32_t frees;
+        uint32_t reallocs;
+        uint32_t expands;
+        uint32_t contracts;
+
+        uint32_t size_classes[HEAP_STATS_SIZE_CLASSES];
+    } __packed;
+
+    // Exported by the kernel through kexp.
+    __cdecl void kheap_stats(HeapStats* out);
+    __cdecl void kheap_dump();
+}
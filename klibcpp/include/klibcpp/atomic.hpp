@@ -95,6 +95,10 @@ namespace kstd {
                 return __atomic_fetch_sub(&value_, value, static_cast<int>(order));
             }
 
+            uint32_t fetch_or(uint32_t value, MemoryOrder order = MemoryOrder::SeqCst) {
+                return __atomic_fetch_or(&value_, value, static_cast<int>(order));
+            }
+
         private:
             alignas(sizeof(uint32_t)) mutable uint32_t value_;
     };
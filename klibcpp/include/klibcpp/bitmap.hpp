@@ -15,21 +15,24 @@ class FixedBitmapAllocator : public NonTransferable {
         static_assert(MaxUnits > 0, "MaxUnits must be > 0");
         static_assert(UnitSize > 0, "UnitSize must be > 0");
 
-        static constexpr uint32_t BASE_ADDR   = BaseAddr;
-        static constexpr uint32_t MAX_UNITS   = MaxUnits;
-        static constexpr uint32_t UNIT_SIZE   = UnitSize;
-        static constexpr uint32_t BITMAP_SIZE = (MaxUnits + 31u) / 32u;
+        static constexpr uint32_t BASE_ADDR    = BaseAddr;
+        static constexpr uint32_t MAX_UNITS    = MaxUnits;
+        static constexpr uint32_t UNIT_SIZE    = UnitSize;
+        static constexpr uint32_t BITMAP_SIZE  = (MaxUnits + 31u) / 32u;
+        static constexpr uint32_t SUMMARY_SIZE = (BITMAP_SIZE + 31u) / 32u;
 
         constexpr FixedBitmapAllocator()
-            : bitmap{}, allocated_units_(0) {}
+            : bitmap{}, full_words{}, allocated_units_(0) {}
 
         void clear() {
             memset(reinterpret_cast<uint8_t*>(bitmap), 0, sizeof(bitmap));
+            memset(reinterpret_cast<uint8_t*>(full_words), 0, sizeof(full_words));
             allocated_units_ = 0;
         }
 
         void set() {
             memset(reinterpret_cast<uint8_t*>(bitmap), 0xFF, sizeof(bitmap));
+            memset(reinterpret_cast<uint8_t*>(full_words), 0xFF, sizeof(full_words));
             allocated_units_ = MAX_UNITS;
         }
 
@@ -40,57 +43,70 @@ class FixedBitmapAllocator : public NonTransferable {
             if (count > MAX_UNITS)
                 kstd::panic("alloc_units: request too large");
 
-            const uint32_t last = MAX_UNITS - count;
+            AddrT addr;
+            if (!try_alloc_units(count, addr))
+                kstd::panic("alloc_units: out of memory");
 
-            for (uint32_t i = 0; i <= last; ++i) {
-                bool found = true;
+            return addr;
+        }
 
-                for (uint32_t j = 0; j < count; ++j) {
-                    if (test_bit(i + j)) {
-                        found = false;
-                        i    += j;
-                        break;
-                    }
-                }
+        // alloc_units() for callers that can back off: returns false instead of panicking.
+        bool try_alloc_units(uint32_t count, AddrT& addr) {
+            if (count == 0 || count > MAX_UNITS)
+                return false;
 
-                if (found) {
-                    for (uint32_t j = 0; j < count; ++j)
-                        set_bit(i + j);
+            const uint32_t last  = MAX_UNITS - count;
+            uint32_t       start = find_free(0);
 
+            while (start != npos && start <= last) {
+                const uint32_t used = find_used(start, start + count);
+
+                if (used == npos) {
+                    set_range(start, start + count);
                     allocated_units_ += count;
-                    return static_cast<AddrT>(BASE_ADDR + i * UNIT_SIZE);
+                    addr              = static_cast<AddrT>(BASE_ADDR + start * UNIT_SIZE);
+                    return true;
                 }
+
+                start = find_free(used + 1);
             }
 
-            kstd::panic("alloc_units: out of memory");
-            return 0;
+            return false;
         }
 
         void free_units(AddrT base, uint32_t count) {
             if (count == 0)
                 return;
 
-            if (base < BASE_ADDR)
-                kstd::panic("free_units: address below base");
+            const uint32_t start = unit_index(base, count, "free_units");
 
-            const uint32_t offset = static_cast<uint32_t>(base - BASE_ADDR);
-
-            if ((offset % UNIT_SIZE) != 0)
-                kstd::panic("free_units: unaligned address");
+            if (count_used(start, start + count) != count)
+                kstd::panic("free_units: double free");
 
-            const uint32_t start = offset / UNIT_SIZE;
+            clear_range(start, start + count);
+            allocated_units_ -= count;
+        }
 
-            if (start + count > MAX_UNITS)
-                kstd::panic("free_units: invalid range");
+        /*
+            Takes the first free run, capped at `max` units, and stores its
+            length in `count`. Unlike alloc_units() it never panics: `count` is
+            0 when nothing is free.
+        */
+        AddrT alloc_units_upto(uint32_t max, uint32_t& count) {
+            count = 0;
 
-            for (uint32_t i = 0; i < count; ++i) {
-                if (!test_bit(start + i))
-                    kstd::panic("free_units: double free");
+            const uint32_t start = max ? find_free(0) : npos;
+            if (start == npos)
+                return 0;
 
-                clear_bit(start + i);
-            }
+            const uint32_t limit = max < MAX_UNITS - start ? start + max : MAX_UNITS;
+            const uint32_t used  = find_used(start, limit);
+            const uint32_t end   = used == npos ? limit : used;
 
-            allocated_units_ -= count;
+            set_range(start, end);
+            count             = end - start;
+            allocated_units_ += count;
+            return static_cast<AddrT>(BASE_ADDR + start * UNIT_SIZE);
         }
 
         AddrT alloc_unit() {
@@ -101,54 +117,30 @@ class FixedBitmapAllocator : public NonTransferable {
             free_units(addr, 1);
         }
 
-        void mark_units_free(AddrT base, uint32_t count) {
+        // Returns the number of units that were used before the call.
+        uint32_t mark_units_free(AddrT base, uint32_t count) {
             if (count == 0)
-                return;
-
-            if (base < BASE_ADDR)
-                kstd::panic("mark_units_free: address below base");
-
-            const uint32_t offset = static_cast<uint32_t>(base - BASE_ADDR);
-
-            if ((offset % UNIT_SIZE) != 0)
-                kstd::panic("mark_units_free: unaligned address");
-
-            const uint32_t start = offset / UNIT_SIZE;
+                return 0;
 
-            if (start + count > MAX_UNITS)
-                kstd::panic("mark_units_free: invalid range");
+            const uint32_t start = unit_index(base, count, "mark_units_free");
+            const uint32_t freed = count_used(start, start + count);
 
-            for (uint32_t i = 0; i < count; ++i) {
-                if (test_bit(start + i)) {
-                    clear_bit(start + i);
-                    --allocated_units_;
-                }
-            }
+            clear_range(start, start + count);
+            allocated_units_ -= freed;
+            return freed;
         }
 
-        void mark_units_used(AddrT base, uint32_t count) {
+        // Returns the number of units that were free before the call.
+        uint32_t mark_units_used(AddrT base, uint32_t count) {
             if (count == 0)
-                return;
-
-            if (base < BASE_ADDR)
-                kstd::panic("mark_units_used: address below base");
-
-            const uint32_t offset = static_cast<uint32_t>(base - BASE_ADDR);
-
-            if ((offset % UNIT_SIZE) != 0)
-                kstd::panic("mark_units_used: unaligned address");
-
-            const uint32_t start = offset / UNIT_SIZE;
+                return 0;
 
-            if (start + count > MAX_UNITS)
-                kstd::panic("mark_units_used: invalid range");
+            const uint32_t start = unit_index(base, count, "mark_units_used");
+            const uint32_t taken = count - count_used(start, start + count);
 
-            for (uint32_t i = 0; i < count; ++i) {
-                if (!test_bit(start + i)) {
-                    set_bit(start + i);
-                    ++allocated_units_;
-                }
-            }
+            set_range(start, start + count);
+            allocated_units_ += taken;
+            return taken;
         }
 
         bool contains(AddrT addr) const {
@@ -180,18 +172,128 @@ class FixedBitmapAllocator : public NonTransferable {
         }
 
     private:
+        static constexpr uint32_t npos = 0xFFFFFFFF;
+
         uint32_t bitmap[BITMAP_SIZE];
+        /*
+            One bit per bitmap word, set while the word is fully used. Marking
+            full words rather than words with free space keeps a zero-initialised
+            allocator consistent, and lets a search skip 32 full words at once.
+        */
+        uint32_t full_words[SUMMARY_SIZE];
         uint32_t allocated_units_;
 
-        void set_bit(uint32_t bit) {
-            bitmap[bit / 32u] |= (1u << (bit % 32u));
+        uint32_t unit_index(AddrT base, uint32_t count, const char* who) const {
+            if (base < BASE_ADDR)
+                kstd::panic("%s: address below base", who);
+
+            const uint32_t offset = static_cast<uint32_t>(base - BASE_ADDR);
+
+            if ((offset % UNIT_SIZE) != 0)
+                kstd::panic("%s: unaligned address", who);
+
+            const uint32_t start = offset / UNIT_SIZE;
+
+            if (count > MAX_UNITS || start > MAX_UNITS - count)
+                kstd::panic("%s: invalid range", who);
+
+            return start;
+        }
+
+        // Mask of the bits of word `w` that fall inside [start, end).
+        static uint32_t word_mask(uint32_t w, uint32_t start, uint32_t end) {
+            const uint32_t lo = (w == start / 32u) ? start % 32u : 0;
+            const uint32_t hi = (w == (end - 1) / 32u) ? (end - 1) % 32u : 31u;
+
+            return (~0u << lo) & (~0u >> (31u - hi));
+        }
+
+        // The kernel links without libgcc, so no __builtin_popcount.
+        static uint32_t popcount(uint32_t v) {
+            v = v - ((v >> 1) & 0x55555555u);
+            v = (v & 0x33333333u) + ((v >> 2) & 0x33333333u);
+            v = (v + (v >> 4)) & 0x0F0F0F0Fu;
+            return (v * 0x01010101u) >> 24;
+        }
+
+        void update_summary(uint32_t w) {
+            if (bitmap[w] == ~0u)
+                full_words[w / 32u] |= (1u << (w % 32u));
+            else
+                full_words[w / 32u] &= ~(1u << (w % 32u));
+        }
+
+        void set_range(uint32_t start, uint32_t end) {
+            for (uint32_t w = start / 32u; w <= (end - 1) / 32u; ++w) {
+                bitmap[w] |= word_mask(w, start, end);
+                update_summary(w);
+            }
+        }
+
+        void clear_range(uint32_t start, uint32_t end) {
+            for (uint32_t w = start / 32u; w <= (end - 1) / 32u; ++w) {
+                bitmap[w] &= ~word_mask(w, start, end);
+                update_summary(w);
+            }
+        }
+
+        uint32_t count_used(uint32_t start, uint32_t end) const {
+            uint32_t used = 0;
+
+            for (uint32_t w = start / 32u; w <= (end - 1) / 32u; ++w)
+                used += popcount(bitmap[w] & word_mask(w, start, end));
+
+            return used;
+        }
+
+        // First word at or after `w` that has at least one free bit.
+        uint32_t next_open_word(uint32_t w) const {
+            uint32_t s = w / 32u;
+            if (s >= SUMMARY_SIZE)
+                return npos;
+
+            uint32_t open = ~full_words[s] & (~0u << (w % 32u));
+            while (!open) {
+                if (++s >= SUMMARY_SIZE)
+                    return npos;
+
+                open = ~full_words[s];
+            }
+
+            w = s * 32u + static_cast<uint32_t>(__builtin_ctz(open));
+            return w < BITMAP_SIZE ? w : npos;
+        }
+
+        uint32_t find_free(uint32_t from) const {
+            if (from >= MAX_UNITS)
+                return npos;
+
+            uint32_t w    = from / 32u;
+            uint32_t free = ~bitmap[w] & (~0u << (from % 32u));
+
+            if (!free) {
+                w = next_open_word(w + 1);
+                if (w == npos)
+                    return npos;
+
+                free = ~bitmap[w];
+            }
+
+            const uint32_t bit = w * 32u + static_cast<uint32_t>(__builtin_ctz(free));
+            return bit < MAX_UNITS ? bit : npos;
         }
 
-        void clear_bit(uint32_t bit) {
-            bitmap[bit / 32u] &= ~(1u << (bit % 32u));
+        uint32_t find_used(uint32_t start, uint32_t end) const {
+            for (uint32_t w = start / 32u; w <= (end - 1) / 32u; ++w) {
+                const uint32_t used = bitmap[w] & word_mask(w, start, end);
+                if (used)
+                    return w * 32u + static_cast<uint32_t>(__builtin_ctz(used));
+            }
+
+            return npos;
         }
 
         bool test_bit(uint32_t bit) const {
             return (bitmap[bit / 32u] & (1u << (bit % 32u))) != 0;
         }
-};
+};
\ No newline at end of file
@@ -0,0 +1,404 @@
+#pragma once
+
+#include <klibcpp/cstdlib.hpp>
+#include <klibcpp/cstdint.hpp>
+#include <klibcpp/trivial.hpp>
+#include <klibcpp/tree_bitmap.hpp>
+
+/*
+    Binary buddy allocator with the same interface as FixedBitmapAllocator.
+
+    Free blocks of every order are tracked in one TreeBitmap where order k
+    occupies bits [order_offset(k), order_offset(k) + (MaxUnits >> k)). Orders
+    are laid out in ascending order, so a single find_next() from the start of
+    order k yields the smallest free block of order >= k.
+
+    A default-constructed allocator has every unit marked as used; callers seed
+    it with mark_units_free() or clear().
+*/
+template<
+    uint32_t BaseAddr,
+    uint32_t MaxUnits,
+    uint32_t UnitSize,
+    uint32_t MaxOrder = 10,
+    typename AddrT = uint32_t
+>
+class FixedBuddyAllocator : public NonTransferable {
+    public:
+        static_assert(MaxUnits > 0, "MaxUnits must be > 0");
+        static_assert(UnitSize > 0, "UnitSize must be > 0");
+        static_assert(MaxOrder < 31, "MaxOrder is too large");
+        static_assert((MaxUnits % (1u << MaxOrder)) == 0, "MaxUnits must be a multiple of the largest block");
+
+        static constexpr uint32_t BASE_ADDR = BaseAddr;
+        static constexpr uint32_t MAX_UNITS = MaxUnits;
+        static constexpr uint32_t UNIT_SIZE = UnitSize;
+        static constexpr uint32_t MAX_ORDER = MaxOrder;
+        static constexpr uint32_t ORDERS    = MaxOrder + 1;
+
+        static constexpr uint32_t order_offset(uint32_t order) {
+            uint32_t offset = 0;
+            for (uint32_t k = 0; k < order; ++k)
+                offset += MaxUnits >> k;
+
+            return offset;
+        }
+
+        static constexpr uint32_t order_for(uint32_t count) {
+            uint32_t order = 0;
+            while ((1u << order) < count)
+                ++order;
+
+            return order;
+        }
+
+        constexpr FixedBuddyAllocator()
+            : free_map{}, free_units_(0) {}
+
+        void clear() {
+            free_map.reset_all();
+
+            for (uint32_t u = 0; u < MAX_UNITS; u += BLOCK_MAX)
+                free_map.set(block_bit(MAX_ORDER, u));
+
+            free_units_ = MAX_UNITS;
+        }
+
+        void set() {
+            free_map.reset_all();
+            free_units_ = 0;
+        }
+
+        AddrT alloc_units(uint32_t count) {
+            if (count == 0)
+                return 0;
+
+            if (count > MAX_UNITS)
+                kstd::panic("alloc_units: request too large");
+
+            uint32_t unit;
+            uint32_t span;
+
+            if (count <= BLOCK_MAX) {
+                const uint32_t order = order_for(count);
+
+                unit = alloc_block(order);
+                span = 1u << order;
+            } else {
+                span = (count + BLOCK_MAX - 1) & ~(BLOCK_MAX - 1);
+                unit = alloc_max_run(span / BLOCK_MAX);
+            }
+
+            if (unit == npos) {
+                kstd::panic("alloc_units: out of memory");
+                return 0;
+            }
+
+            free_range(unit + count, unit + span);
+
+            free_units_ -= count;
+            return static_cast<AddrT>(BASE_ADDR + unit * UNIT_SIZE);
+        }
+
+        void free_units(AddrT base, uint32_t count) {
+            if (count == 0)
+                return;
+
+            const uint32_t start = unit_index(base, count, "free_units");
+            const uint32_t end   = start + count;
+
+            for (uint32_t u = start; u < end; ) {
+                const uint32_t order = largest_fit(u, end);
+
+                if (!block_allocated(u, order))
+                    kstd::panic("free_units: double free");
+
+                free_block(u, order);
+                u += 1u << order;
+            }
+
+            free_units_ += count;
+        }
+
+        /*
+            Takes the largest free block that fits in `max` units and stores
+            its size in `count`. Unlike alloc_units() it never panics: `count`
+            is 0 when nothing is free.
+        */
+        AddrT alloc_units_upto(uint32_t max, uint32_t& count) {
+            count = 0;
+            if (max == 0)
+                return 0;
+
+            uint32_t order = 31u - static_cast<uint32_t>(__builtin_clz(max));
+            if (order > MAX_ORDER)
+                order = MAX_ORDER;
+
+            while (true) {
+                const uint32_t unit = alloc_block(order);
+
+                if (unit != npos) {
+                    count        = 1u << order;
+                    free_units_ -= count;
+                    return static_cast<AddrT>(BASE_ADDR + unit * UNIT_SIZE);
+                }
+
+                if (!order)
+                    return 0;
+
+                --order;
+            }
+        }
+
+        AddrT alloc_unit() {
+            return alloc_units(1);
+        }
+
+        void free_unit(AddrT addr) {
+            free_units(addr, 1);
+        }
+
+        // Returns the number of units that were used before the call.
+        uint32_t mark_units_free(AddrT base, uint32_t count) {
+            if (count == 0)
+                return 0;
+
+            const uint32_t start  = unit_index(base, count, "mark_units_free");
+            const uint32_t end    = start + count;
+            const uint32_t before = free_units_;
+
+            for (uint32_t u = start; u < end; ) {
+                const uint32_t order = largest_fit(u, end);
+                mark_block_free(u, order);
+                u += 1u << order;
+            }
+
+            return free_units_ - before;
+        }
+
+        // Returns the number of units that were free before the call.
+        uint32_t mark_units_used(AddrT base, uint32_t count) {
+            if (count == 0)
+                return 0;
+
+            const uint32_t start  = unit_index(base, count, "mark_units_used");
+            const uint32_t end    = start + count;
+            const uint32_t before = free_units_;
+
+            for (uint32_t u = start; u < end; ) {
+                const uint32_t order = containing_free_order(u);
+
+                if (order == npos) {
+                    u = next_free_unit(u);
+                    continue;
+                }
+
+                const uint32_t block = u & ~((1u << order) - 1);
+                const uint32_t limit = block + (1u << order);
+                const uint32_t taken = limit < end ? limit : end;
+
+                free_map.reset(block_bit(order, block));
+                free_range(block, u);
+                free_range(taken, limit);
+
+                free_units_ -= taken - u;
+                u            = taken;
+            }
+
+            return before - free_units_;
+        }
+
+        bool contains(AddrT addr) const {
+            if (addr < BASE_ADDR)
+                return false;
+
+            const uint32_t offset = static_cast<uint32_t>(addr - BASE_ADDR);
+            return (offset / UNIT_SIZE) < MAX_UNITS;
+        }
+
+        bool allocated(AddrT addr) const {
+            if (!contains(addr))
+                return false;
+
+            const uint32_t offset = static_cast<uint32_t>(addr - BASE_ADDR);
+
+            if ((offset % UNIT_SIZE) != 0)
+                return false;
+
+            return containing_free_order(offset / UNIT_SIZE) == npos;
+        }
+
+        uint32_t allocated_unit_count() const {
+            return MAX_UNITS - free_units_;
+        }
+
+        uint32_t free_unit_count() const {
+            return free_units_;
+        }
+
+    private:
+        static constexpr uint32_t BLOCK_MAX = 1u << MaxOrder;
+        static constexpr uint32_t npos      = 0xFFFFFFFF;
+
+        TreeBitmap<order_offset(ORDERS)> free_map;
+        uint32_t free_units_;
+
+        static constexpr uint32_t block_bit(uint32_t order, uint32_t unit) {
+            return order_offset(order) + (unit >> order);
+        }
+
+        static uint32_t largest_fit(uint32_t unit, uint32_t end) {
+            uint32_t order = unit ? static_cast<uint32_t>(__builtin_ctz(unit)) : MAX_ORDER;
+            if (order > MAX_ORDER)
+                order = MAX_ORDER;
+
+            while (unit + (1u << order) > end)
+                --order;
+
+            return order;
+        }
+
+        uint32_t unit_index(AddrT base, uint32_t count, const char* who) const {
+            if (base < BASE_ADDR)
+                kstd::panic("%s: address below base", who);
+
+            const uint32_t offset = static_cast<uint32_t>(base - BASE_ADDR);
+
+            if ((offset % UNIT_SIZE) != 0)
+                kstd::panic("%s: unaligned address", who);
+
+            const uint32_t start = offset / UNIT_SIZE;
+
+            if (count > MAX_UNITS || start > MAX_UNITS - count)
+                kstd::panic("%s: invalid range", who);
+
+            return start;
+        }
+
+        uint32_t containing_free_order(uint32_t unit) const {
+            for (uint32_t order = 0; order < ORDERS; ++order) {
+                if (free_map.test(block_bit(order, unit)))
+                    return order;
+            }
+
+            return npos;
+        }
+
+        // True if no free block overlaps [unit, unit + 2^order).
+        bool block_allocated(uint32_t unit, uint32_t order) const {
+            for (uint32_t k = order; k < ORDERS; ++k) {
+                if (free_map.test(block_bit(k, unit)))
+                    return false;
+            }
+
+            for (uint32_t k = 0; k < order; ++k) {
+                if (free_map.any_in_range(block_bit(k, unit), 1u << (order - k)))
+                    return false;
+            }
+
+            return true;
+        }
+
+        uint32_t next_free_unit(uint32_t unit) const {
+            uint32_t next = MAX_UNITS;
+
+            for (uint32_t order = 0; order < ORDERS; ++order) {
+                const uint32_t first = (unit + (1u << order) - 1) >> order;
+                if (first >= (MAX_UNITS >> order))
+                    continue;
+
+                const uint32_t bit = free_map.find_next(order_offset(order) + first);
+                if (bit == npos || bit >= order_offset(order + 1))
+                    continue;
+
+                const uint32_t start = (bit - order_offset(order)) << order;
+                if (start < next)
+                    next = start;
+            }
+
+            return next;
+        }
+
+        void free_block(uint32_t unit, uint32_t order) {
+            while (order < MAX_ORDER) {
+                const uint32_t buddy = unit ^ (1u << order);
+                const uint32_t bit   = block_bit(order, buddy);
+
+                if (!free_map.test(bit))
+                    break;
+
+                free_map.reset(bit);
+                unit &= ~(1u << order);
+                ++order;
+            }
+
+            free_map.set(block_bit(order, unit));
+        }
+
+        void free_range(uint32_t start, uint32_t end) {
+            for (uint32_t u = start; u < end; ) {
+                const uint32_t order = largest_fit(u, end);
+                free_block(u, order);
+                u += 1u << order;
+            }
+        }
+
+        void mark_block_free(uint32_t unit, uint32_t order) {
+            if (block_allocated(unit, order)) {
+                free_block(unit, order);
+                free_units_ += 1u << order;
+                return;
+            }
+
+            if (containing_free_order(unit) >= order && containing_free_order(unit) != npos)
+                return;
+
+            // Partially free: some smaller block inside is already free.
+            mark_block_free(unit, order - 1);
+            mark_block_free(unit + (1u << (order - 1)), order - 1);
+        }
+
+        uint32_t alloc_block(uint32_t order) {
+            const uint32_t bit = free_map.find_next(order_offset(order));
+            if (bit == npos)
+                return npos;
+
+            uint32_t found = order;
+            while (bit >= order_offset(found + 1))
+                ++found;
+
+            const uint32_t unit = (bit - order_offset(found)) << found;
+            free_map.reset(bit);
+
+            while (found > order) {
+                --found;
+                free_map.set(block_bit(found, unit + (1u << found)));
+            }
+
+            return unit;
+        }
+
+        uint32_t alloc_max_run(uint32_t blocks) {
+            const uint32_t base = order_offset(MAX_ORDER);
+            const uint32_t last = MAX_UNITS / BLOCK_MAX;
+            uint32_t       run  = 0;
+
+            for (uint32_t i = free_map.find_next(base) - base; i < last; ++i) {
+                if (!free_map.test(base + i)) {
+                    run = 0;
+                    continue;
+                }
+
+                if (++run < blocks)
+                    continue;
+
+                const uint32_t first = i + 1 - blocks;
+                for (uint32_t j = first; j <= i; ++j)
+                    free_map.reset(base + j);
+
+                return first * BLOCK_MAX;
+            }
+
+            return npos;
+        }
+};
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <klibcpp/cstdlib.hpp>
+#include <klibcpp/cstdint.hpp>
+#include <klibcpp/trivial.hpp>
+
+/*
+    Multi-level bitmap. Every level keeps one summary bit per 32-bit word of
+    the level below, set while that word is non-zero, so searching for a set
+    bit touches one word per level instead of scanning the whole map.
+*/
+template<uint32_t Bits, bool Leaf = (Bits <= 32u)>
+class TreeBitmap;
+
+template<uint32_t Bits>
+class TreeBitmap<Bits, true> {
+    public:
+        static constexpr uint32_t BITS  = Bits;
+        static constexpr uint32_t WORDS = 1;
+        static constexpr uint32_t npos  = 0xFFFFFFFF;
+
+        constexpr TreeBitmap() : word_(0) {}
+
+        void reset_all() {
+            word_ = 0;
+        }
+
+        void set(uint32_t bit) {
+            word_ |= (1u << bit);
+        }
+
+        void reset(uint32_t bit) {
+            word_ &= ~(1u << bit);
+        }
+
+        bool test(uint32_t bit) const {
+            return (word_ & (1u << bit)) != 0;
+        }
+
+        bool any() const {
+            return word_ != 0;
+        }
+
+        uint32_t word(uint32_t) const {
+            return word_;
+        }
+
+        uint32_t find_next(uint32_t from) const {
+            if (from >= 32u)
+                return npos;
+
+            const uint32_t masked = word_ & (~0u << from);
+            return masked ? static_cast<uint32_t>(__builtin_ctz(masked)) : npos;
+        }
+
+        bool any_in_range(uint32_t first, uint32_t count) const {
+            const uint32_t found = find_next(first);
+            return found != npos && found - first < count;
+        }
+
+    private:
+        uint32_t word_;
+};
+
+template<uint32_t Bits>
+class TreeBitmap<Bits, false> {
+    public:
+        static constexpr uint32_t BITS  = Bits;
+        static constexpr uint32_t WORDS = (Bits + 31u) / 32u;
+        static constexpr uint32_t npos  = 0xFFFFFFFF;
+
+        constexpr TreeBitmap() : words_{}, summary_() {}
+
+        void reset_all() {
+            memset(reinterpret_cast<uint8_t*>(words_), 0, sizeof(words_));
+            summary_.reset_all();
+        }
+
+        void set(uint32_t bit) {
+            const uint32_t w = bit / 32u;
+
+            if (!words_[w])
+                summary_.set(w);
+
+            words_[w] |= (1u << (bit % 32u));
+        }
+
+        void reset(uint32_t bit) {
+            const uint32_t w = bit / 32u;
+
+            words_[w] &= ~(1u << (bit % 32u));
+
+            if (!words_[w])
+                summary_.reset(w);
+        }
+
+        bool test(uint32_t bit) const {
+            return (words_[bit / 32u] & (1u << (bit % 32u))) != 0;
+        }
+
+        bool any() const {
+            return summary_.any();
+        }
+
+        uint32_t word(uint32_t index) const {
+            return words_[index];
+        }
+
+        uint32_t find_next(uint32_t from) const {
+            if (from >= WORDS * 32u)
+                return npos;
+
+            uint32_t       w      = from / 32u;
+            const uint32_t masked = words_[w] & (~0u << (from % 32u));
+
+            if (masked)
+                return w * 32u + static_cast<uint32_t>(__builtin_ctz(masked));
+
+            w = summary_.find_next(w + 1);
+            if (w == npos)
+                return npos;
+
+            return w * 32u + static_cast<uint32_t>(__builtin_ctz(words_[w]));
+        }
+
+        bool any_in_range(uint32_t first, uint32_t count) const {
+            const uint32_t found = find_next(first);
+            return found != npos && found - first < count;
+        }
+
+    private:
+        uint32_t words_[WORDS];
+        TreeBitmap<WORDS> summary_;
+};
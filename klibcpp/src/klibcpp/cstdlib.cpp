@@ -35,7 +35,7 @@ void operator delete[](void* ptr, size_t size) noexcept {
 
 void* operator new(size_t size, std::align_val_t alignment) {
     if (api.kmalloc)
-        return api.kmalloc(size, (uint32_t)alignment > 0);
+        return api.kmalloc(size, (uint32_t)alignment);
 
     kstd::panic("kmalloc not found");
     return (void*)0xDEADADDD; // Unreachable, warn suppression